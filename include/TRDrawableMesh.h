@@ -80,7 +80,8 @@ namespace TinyRenderer
 	public:
 		typedef std::shared_ptr<TRDrawableMesh> ptr;
 
-		TRDrawableMesh(const std::string &path, bool generatedMipmap);
+		//Note: compressedTexture -> the texture maps are block compressed according to their usages
+		TRDrawableMesh(const std::string &path, bool generatedMipmap, bool compressedTexture = false);
 
 		void clear();
 
@@ -99,6 +100,8 @@ namespace TinyRenderer
 		void setEmissionCoff(const glm::vec3 &cof) { m_drawingMaterial.m_kE = cof; }
 		void setSpecularExponent(const float &cof) { m_drawingMaterial.m_shininess = cof; }
 		void setTransparency(const float &alpha) { m_drawingMaterial.m_transparency = alpha; }
+		//Anisotropic filtering of the texture maps (1 -> disabled)
+		void setMaxAnisotropy(const int &maxAnisotropy);
 
 		//Getter
 		const glm::vec3& getAmbientCoff() const { return m_drawingMaterial.m_kA; }
@@ -119,7 +122,7 @@ namespace TinyRenderer
 		TRDrawableBuffer& getDrawableSubMeshes() { return m_drawables; }
 
 	protected:
-		void importMeshFromFile(const std::string &path, bool generatedMipmap = true);
+		void importMeshFromFile(const std::string &path, bool generatedMipmap = true, bool compressedTexture = false);
 
 	protected:
 		TRDrawableBuffer m_drawables;
@@ -3,9 +3,12 @@
 
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <cstdint>
 
 #include "glm/glm.hpp"
 #include "TRPixelSampler.h"
+#include "TRShadingState.h"
 
 namespace TinyRenderer
 {
@@ -17,7 +20,10 @@ namespace TinyRenderer
 		typedef std::shared_ptr<TRFrameBuffer> ptr;
 
 		// ctor/dtor.
-		TRFrameBuffer(int width, int height);
+		//Note: samplingNum is the number of MSAA sampling points per pixel (1, 2, 4 or 8)
+		TRFrameBuffer(int width, int height, int samplingNum = 4, 
+			TRDepthFormat depthFormat = TRDepthFormat::TR_DEPTH_FORMAT_D32F,
+			TRReverseZMode reverseZ = TRReverseZMode::TR_REVERSE_Z_ENABLE);
 		~TRFrameBuffer() = default;
 
 		void clearDepth(const float &depth);
@@ -27,26 +33,146 @@ namespace TinyRenderer
 		// Getter.
 		int getWidth() const { return m_width; }
 		int getHeight() const { return m_height; }
-		const TRDepthBuffer &getDepthBuffer() const { return m_depthBuffer; }
+		int getSamplingNum() const { return m_samplingNum; }
+		TRDepthFormat getDepthFormat() const { return m_depthFormat; }
+		TRReverseZMode getReverseZMode() const { return m_reverseZ; }
+		const TRColorBuffer &getResolvedBuffer() const { return m_resolvedBuffer; }
+		//Note: the raw buffer is stale in the tiles cleared since their last writing,
+		//      and only the sampling point 0 of the uniform pixels is valid (see isColorUniform())
 		const TRColorBuffer &getColorBuffer() const { return m_colorBuffer; }
+		bool isColorUniform(const uint &x, const uint &y) const 
+		{ 
+			return isTileCleared(m_colorTileState, x, y) || m_colorUniform[xyToIndex(x, y)] != 0; 
+		}
+
+		//Tiled memory layout of the depth and color buffers: 8x8 pixels micro tiles in 64x64 pixels macro tiles,
+		//hence the 2x2 blocks and the tiles of the rasterizer are contiguous in memory.
+		//Note: the sampling points of pixel xyToIndex(x,y) start at xyToIndex(x,y) * samplingNum,
+		//      and the resolved buffer is linear (row-major)
+		uint xyToIndex(const uint &x, const uint &y) const
+		{
+			//Note: this is optimized version of
+			//((y / 64) * m_widthInMacroTiles + (x / 64)) * 4096 + ((y % 64) / 8 * 8 + (x % 64) / 8) * 64 + (y % 8) * 8 + x % 8
+			return ((((y >> 6) * m_widthInMacroTiles) + (x >> 6)) << 12) | (((y >> 3) & 7) << 9) | (((x >> 3) & 7) << 6) |
+				((y & 7) << 3) | (x & 7);
+		}
+
+		//Depth is read and written as 1/w (the greater is the closer), and stored in the depth format
+		//Note: the near plane normalizes the unorm formats, it should be set before clearing
+		void setDepthNear(const float &near);
+		//Depth rounded to the precision of the depth format, i.e. the one read back after writing
+		//Note: the depth to be tested should be rounded as well, so that TR_DEPTH_FUNC_EQUAL holds
+		float quantizeDepth(const float &depth) const { return m_depthExact ? depth : roundDepth(depth); }
 
 		float readDepth(const uint &x, const uint &y, const uint &i) const;
 		TRPixelRGBA readColor(const uint &x, const uint &y, const uint &i) const;
 
 		void writeDepth(const uint &x, const uint &y, const uint &i, const float &value);
 		void writeColor(const uint &x, const uint &y, const uint &i, const glm::vec4 &color);
-		void writeColorWithMask(const uint &x, const uint &y, const glm::vec4 &color, const TRMaskPixelSampler &mask);
-		void writeColorWithMaskAlphaBlending(const uint &x, const uint &y, const glm::vec4 &color, const TRMaskPixelSampler &mask);
-		void writeDepthWithMask(const uint &x, const uint &y, const TRDepthPixelSampler &depth, const TRMaskPixelSampler &mask);
+		//Note: bit s of mask -> sampling point s, and depth[s] is the depth of sampling point s
+		void writeColorWithMask(const uint &x, const uint &y, const glm::vec4 &color, const unsigned int &mask);
+		void writeColorWithMaskAlphaBlending(const uint &x, const uint &y, const glm::vec4 &color, const unsigned int &mask);
+		void writeDepthWithMask(const uint &x, const uint &y, const float *depth, const unsigned int &mask);
 
-		//MSAA resolve
+		//MSAA resolve to the resolved buffer (one color per pixel)
 		const TRColorBuffer &resolve();
 
+		//Change the tile sizes, you should also change the corresponding code in xyToIndex
+		static constexpr int k_microTileSize = 8;
+		static constexpr int k_macroTileSize = 64;
+
+		//Hierarchical depth for coarse occlusion culling
+		//Note: it keeps a conservative farthest depth (i.e. the minimal rhw) of each tile,
+		//      a block inside a tile is occluded if its nearest depth is not greater than that.
+		static constexpr int k_hizTileSize = k_microTileSize;
+		int getHiZWidth() const { return m_hizWidth; }
+		int getHiZHeight() const { return m_hizHeight; }
+		float readHiZDepth(const uint &tx, const uint &ty) const 
+		{
+			return m_hizDepth[ty * m_hizWidth + tx].load(std::memory_order_relaxed);
+		}
+		//Tighten the bound of the tiles written since last refreshing
+		void refreshHiZ();
+
 	private:
+
+		//Copy the color of a uniform pixel to all of its sampling points
+		void expandColor(const uint &pixel);
+
+		//Fast clear: clearing only marks the tiles (the ones of hierarchical depth) as cleared,
+		//a cleared tile reads as the clear value and it is filled by its first writing.
+		//Note: the first writer of a cleared tile fills it while the other writers of the tile wait
+		enum TRTileState
+		{
+			TR_TILE_READY,			//Stored in the buffers
+			TR_TILE_CLEARED,		//Equal to the clear value, not stored yet
+			TR_TILE_FILLING			//Being filled with the clear value
+		};
+		using TileStateBuffer = std::vector<std::atomic<unsigned char>>;
+		bool isTileCleared(const TileStateBuffer &state, const uint &x, const uint &y) const
+		{
+			return state[(y / k_hizTileSize) * m_hizWidth + (x / k_hizTileSize)].load(std::memory_order_acquire) 
+				!= TR_TILE_READY;
+		}
+		static bool beginTileFilling(std::atomic<unsigned char> &state);
+		void acquireDepthTile(const uint &x, const uint &y);
+		void acquireColorTile(const uint &x, const uint &y);
+
+		//Depth format: the unorm formats store near/w (reverse-Z) or 1 - near/w in [0,1], 
+		//and D32F stores 1/w (reverse-Z) or 1 - near/w.
+		//Note: the rounding is monotonic, hence the order of depth (and the depth testing) is preserved
+		static constexpr std::uint32_t k_maxD16 = 0xffff;
+		static constexpr std::uint32_t k_maxD24 = 0xffffff;
+		std::uint32_t encodeUnormDepth(const float &depth, const std::uint32_t &maxValue) const;
+		float decodeUnormDepth(const std::uint32_t &value, const std::uint32_t &maxValue) const;
+		float encodeFloatDepth(const float &depth) const;
+		float decodeFloatDepth(const float &value) const;
+		float roundDepth(const float &depth) const;
+		void updateClearDepth();
+
+		//Access to the depth planes, index = s * m_planeSize + xyToIndex(x,y) for sampling point s
+		float loadDepth(const size_t &index) const;
+		float storeDepth(const size_t &index, const float &depth);			//Returns the rounded depth
+		void fillClearDepth(const size_t &index, const size_t &count);
+		float loadMinDepth(const size_t &index, const size_t &count) const;
+
+		void updateHiZ(const uint &x, const uint &y, const float &depth);
+		void clearHiZ(const float &depth);
 	
-		TRDepthBuffer m_depthBuffer;           // Z-buffer
+		//Z-buffer: one plane per sampling point, hence the depth of the same sampling point of adjacent pixels 
+		//are contiguous (e.g. for vectorized depth testing), and only the plane of the depth format is allocated
+		TRDepthFormat m_depthFormat;
+		TRReverseZMode m_reverseZ;
+		bool m_depthExact;							   // Rounding free (D32F of reverse-Z)
+		float m_depthNear = 1.0f;
+		size_t m_planeSize;
+		std::vector<std::uint16_t> m_depthPlanesD16;
+		std::vector<std::uint32_t> m_depthPlanesD24;
+		TRDepthBuffer m_depthPlanesD32F;
+
 		TRColorBuffer m_colorBuffer;		   // Color buffer
+		TRColorBuffer m_resolvedBuffer;		   // Resolved color buffer
 		unsigned int m_width, m_height;
+		unsigned int m_widthInMacroTiles, m_heightInMacroTiles;
+		unsigned int m_samplingNum;
+		unsigned int m_fullMask;			   // Mask of all of the sampling points
+
+		//Compressed MSAA color: a uniform pixel (e.g. interior of a triangle) stores its color in sampling point 0 only,
+		//and it is expanded to all of the sampling points once they are written different colors (e.g. edges).
+		//Note: the full coverage writes, clears and resolve of the uniform pixels touch one sampling point only
+		std::vector<unsigned char> m_colorUniform;
+
+		int m_hizWidth, m_hizHeight;
+		std::vector<std::atomic<float>> m_hizDepth;		// Lower bound of the depth of each tile
+		std::vector<std::atomic<bool>> m_hizDirty;		// Tiles need to be refreshed
+
+		float m_clearDepthValue = 1.0f;					// Clear depth requested
+		float m_clearDepth = 1.0f;						// Clear depth rounded to the depth format
+		std::uint32_t m_clearDepthUnorm = 0;			// Stored clear depth of the unorm formats
+		float m_clearDepthFloat = 1.0f;					// Stored clear depth of D32F
+		TRPixelRGBA m_clearColor = k_trBlack;
+		TileStateBuffer m_depthTileState;				// Fast clear state of each tile
+		TileStateBuffer m_colorTileState;
 	};
 }
 
@@ -8,86 +8,75 @@
 
 namespace TinyRenderer
 {
-	template <typename T, size_t N>
-	class TRIPixelSampler
-	{
-	public:
-		std::array<T, N> samplers;
-
-		static size_t getSamplingNum() { return N; }
-
-		T& operator[](const int &index) { return samplers[index]; }
-		const T& operator[](const int &index) const { return samplers[index]; }
-
-	};
+	//Sampling pattern of N sampling points per pixel
+	//Note: the offsets are relative to the pixel center, and multiples of 1/16 pixel
+	template <int N>
+	class TRSamplingPattern;
 
 	//1x Sampling Point
-	template <typename T>
-	class TRPixelSampler1X : public TRIPixelSampler<T, 1>
+	template <>
+	class TRSamplingPattern<1>
 	{
 	public:
-
-		TRPixelSampler1X(const T &value) { samplers.fill(value); }
+		static constexpr int k_samplingNum = 1;
 
 		static const std::array<glm::vec2, 1> &getSamplingOffsets()
 		{
-			return { glm::vec2(0.0f, 0.0f) };
+			static const std::array<glm::vec2, 1> offsets = { glm::vec2(0.0f, 0.0f) };
+			return offsets;
 		}
-
 	};
 
 	//2x Sampling Point
-	template <typename T>
-	class TRPixelSampler2X : public TRIPixelSampler<T, 2>
+	template <>
+	class TRSamplingPattern<2>
 	{
 	public:
-
-		TRPixelSampler2X(const T &value) { samplers.fill(value); }
+		static constexpr int k_samplingNum = 2;
 
 		static const std::array<glm::vec2, 2> &getSamplingOffsets()
 		{
-			return { glm::vec2(-0.25f, -0.25f), glm::vec2(+0.25f, +0.25f) };
+			static const std::array<glm::vec2, 2> offsets = { glm::vec2(-0.25f, -0.25f), glm::vec2(+0.25f, +0.25f) };
+			return offsets;
 		}
-
 	};
 
 	//4x Sampling Point
-	template <typename T>
-	class TRPixelSampler4X : public TRIPixelSampler<T, 4>
+	template <>
+	class TRSamplingPattern<4>
 	{
 	public:
-
-		TRPixelSampler4X(const T &value) { samplers.fill(value); }
+		static constexpr int k_samplingNum = 4;
 
 		static const std::array<glm::vec2, 4> &getSamplingOffsets()
 		{
 			//Sampling points' offset
 			//Note:Rotated grid sampling pattern
 			//Refs: https://mynameismjp.wordpress.com/2012/10/24/msaa-overview/
-			return
+			static const std::array<glm::vec2, 4> offsets =
 			{
 				glm::vec2(+0.125f, +0.375f),
 				glm::vec2(+0.375f, -0.125f),
 				glm::vec2(-0.125f, -0.375f),
 				glm::vec2(-0.375f, +0.125f)
 			};
+			return offsets;
 		}
 	};
 
 	//8x Sampling Point
-	template <typename T>
-	class TRPixelSampler8X : public TRIPixelSampler<T, 8>
+	template <>
+	class TRSamplingPattern<8>
 	{
 	public:
-
-		TRPixelSampler8X(const T &value) { samplers.fill(value); }
+		static constexpr int k_samplingNum = 8;
 
 		static const std::array<glm::vec2, 8> &getSamplingOffsets()
 		{
 			//Sampling points' offset
 			//Note:Rotated grid sampling pattern
 			//Refs: https://mynameismjp.wordpress.com/2012/10/24/msaa-overview/
-			return
+			static const std::array<glm::vec2, 8> offsets =
 			{
 				glm::vec2(-0.375f, +0.375f),
 				glm::vec2(+0.125f, +0.375f),
@@ -98,35 +87,25 @@ namespace TinyRenderer
 				glm::vec2(-0.125f, -0.375f),
 				glm::vec2(+0.375f, -0.375f)
 			};
+			return offsets;
 		}
 	};
 
-#define MSAA4X
-
-#ifdef MSAA4X
-	template<typename T>
-	using TRPixelSampler = TRPixelSampler4X<T>;
-	//Note: MSAA 8X is a little time-consuming
-	//template<typename T>
-	//using TRPixelSampler = TRPixelSampler8X<T>;
-#else
-	template<typename T>
-	using TRPixelSampler = TRPixelSampler1X<T>;
-#endif
+	//Note: the sampling number is selected per renderer at runtime (see TRMSAAMode),
+	//      and the hot paths are instantiated for each of them
+	constexpr int k_maxSamplingNum = 8;
 
 	using TRPixelRGB = std::array<unsigned char, 3>;
 	using TRPixelRGBA = std::array<unsigned char, 4>;
-	using TRMaskPixelSampler = TRPixelSampler<unsigned char>;
-	using TRDepthPixelSampler = TRPixelSampler<float>;
-	using TRColorPixelSampler = TRPixelSampler<TRPixelRGBA>;
 
 	//Framebuffer attachment
-	using TRMaskBuffer = std::vector<TRMaskPixelSampler>;
-	using TRDepthBuffer = std::vector<TRDepthPixelSampler>;
-	using TRColorBuffer = std::vector<TRColorPixelSampler>;
+	//Note: the color of sampling point s of pixel i is stored at i * samplingNum + s,
+	//      while the depth is stored in a separate plane per sampling point
+	using TRDepthBuffer = std::vector<float>;
+	using TRColorBuffer = std::vector<TRPixelRGBA>;
 
 	constexpr TRPixelRGBA k_trWhite = { 255, 255, 255 ,255 };
 	constexpr TRPixelRGBA k_trBlack = { 0, 0, 0, 0 };
 }
 
-#endif
\ No newline at end of file
+#endif
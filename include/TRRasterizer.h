@@ -0,0 +1,92 @@
+#ifndef TRRASTERIZER_H
+#define TRRASTERIZER_H
+
+#include <cstdint>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/type_precision.hpp"
+
+#include "TRPixelSampler.h"
+
+namespace TinyRenderer
+{
+	//Sub-pixel precision of the screen space positions of vertices (fixed-point with k_subPixelBits fractional bits)
+	//Note: pixel (x,y) is centered at (x << k_subPixelBits, y << k_subPixelBits)
+	constexpr int k_subPixelBits = 8;
+	constexpr int k_subPixelScale = 1 << k_subPixelBits;
+
+	//Range of the pixels whose sampling points (within half a pixel from the center) might be in [minPos, maxPos]
+	inline int subPixelToPixelMin(const int &minPos) { return (minPos + k_subPixelScale / 2 - 1) >> k_subPixelBits; }
+	inline int subPixelToPixelMax(const int &maxPos) { return (maxPos + k_subPixelScale / 2) >> k_subPixelBits; }
+
+	//Edge functions setup of a triangle for evaluating the coverage of 2x2 fragments blocks.
+	//Note: lane (f * samplingNum + s) is the sampling point s of fragment f, where
+	//      f0 -> (x+0, y+0), f1 -> (x+1,y+0 ), f2 -> (x+0, y+1), f3 -> (x+1,y+1).
+	//      The edge functions of the fixed-point positions are exact integers (64-bit accumulation).
+	//      Samples is the number of MSAA sampling points per pixel (1, 2, 4 or 8).
+	template<int Samples>
+	class TRQuadCoverageSetup final
+	{
+	public:
+		static constexpr int k_samplingNum = Samples;
+		static constexpr int k_numLanes = 4 * k_samplingNum;
+		static_assert(k_numLanes <= 32, "Coverage of a 2x2 block should fit in 32 bits");
+		static constexpr int k_blockSize = 8;	//Block size of hierarchical traversal in pixels (multiple of 2)
+
+		//Note: lane offsets within this bound keep the 32-bit evaluation exact
+		static constexpr int k_maxLaneOffset = 1 << 29;
+
+		//I, J: increments of the three edge functions per sub-pixel unit along x and y
+		//bias: top left fill rule bias of each edge
+		//rhw: 1/w of the vertices opposite to edge 1, 2 and 0 (i.e. the barycentric order)
+		TRQuadCoverageSetup(const glm::ivec3 &I, const glm::ivec3 &J, const glm::ivec3 &bias,
+			const glm::vec3 &rhw, const float &oneDivDelta);
+
+		alignas(32) int m_laneOffset[3][k_numLanes];	//Offset of the edge functions of each lane's sampling point from f0
+		int m_sampleX[k_samplingNum], m_sampleY[k_samplingNum];		//Sampling offsets in sub-pixel units
+		glm::ivec3 m_I, m_J;
+		int m_bias[3];
+		float m_rhw[3];
+		float m_oneDivDelta;
+		float m_depthDx, m_depthDy;		//Increments of the interpolated depth per pixel along x and y
+		float m_maxDepth;				//The nearest depth of the vertices
+		bool m_wideEdges;				//Lane offsets beyond k_maxLaneOffset, which need 64-bit evaluation
+	};
+
+	//Coverage of a block of pixels against a triangle
+	enum TRBlockCoverage
+	{
+		TR_BLOCK_OUTSIDE,		//None of sampling points is covered
+		TR_BLOCK_PARTIAL,		//Need per-sample edge tests
+		TR_BLOCK_INSIDE			//All of sampling points are covered
+	};
+
+	//Conservative classification of the block of size pixels whose edge functions at the first pixel equal Cx
+	template<int Samples>
+	TRBlockCoverage classifyBlockCoverage(const TRQuadCoverageSetup<Samples> &setup, const glm::i64vec3 &Cx, 
+		const glm::ivec2 &size);
+
+	//Conservative nearest depth (i.e. the maximal rhw) of the triangle within the block
+	template<int Samples>
+	float evaluateBlockMaxDepth(const TRQuadCoverageSetup<Samples> &setup, const glm::i64vec3 &Cx, const glm::ivec2 &size);
+
+	//Coverage kernel of a 2x2 fragments block whose edge functions at f0 equal Cx.
+	//Note: returns the coverage bitmask (bit i -> lane i),
+	//      and the interpolated depth of all of lanes is written to coverageDepth[k_numLanes].
+	template<int Samples>
+	using TRQuadCoverageKernel = unsigned int(*)(const TRQuadCoverageSetup<Samples> &setup, const glm::i64vec3 &Cx,
+		float *coverageDepth);
+
+	//Scalar implementation with 64-bit edge functions (valid for the wide edges as well)
+	//Note: without edge tests, all of lanes are treated as covered (for blocks totally inside)
+	template<int Samples, bool TestEdges>
+	unsigned int evaluateQuadCoverageScalar(const TRQuadCoverageSetup<Samples> &setup, const glm::i64vec3 &Cx,
+		float *coverageDepth);
+
+	//The fastest implementation supported by the running CPU (AVX2 -> SSE2 -> scalar)
+	//Note: the SIMD kernels evaluate 32-bit lanes, hence the triangles with wide edges fall back to the scalar one
+	template<int Samples>
+	TRQuadCoverageKernel<Samples> getQuadCoverageKernel(const bool &testEdges = true, const bool &wideEdges = false);
+}
+
+#endif
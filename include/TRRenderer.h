@@ -1,6 +1,8 @@
 #ifndef TRRENDERER_H
 #define TRRENDERER_H
 
+#include <cstdint>
+
 #include "glm/glm.hpp"
 #include "SDL2/SDL.h"
 
@@ -8,9 +10,102 @@
 #include "TRDrawableMesh.h"
 #include "TRShadingState.h"
 #include "TRShadingPipeline.h"
+#include "TRRasterizer.h"
+
+#include "tbb/spin_mutex.h"
+#include "tbb/cache_aligned_allocator.h"
+#include "tbb/enumerable_thread_specific.h"
 
 namespace TinyRenderer
 {
+	//Striped locks for avoiding accessing conflict of framebuffer among different threads.
+	//Note: each 2x2 pixels block is hashed to one of a fixed number of cache line aligned locks,
+	//      hence the memory footprint is independent of the framebuffer size.
+	class TRFrameBufferMutex final
+	{
+	public:
+		using MutexType = tbb::spin_mutex;
+
+		TRFrameBufferMutex() : m_mutexBuffer(k_numStripes) {}
+
+		MutexType &getLocker(const int &x, const int &y)
+		{
+			//Spatial hashing of 2x2 pixels block
+			const unsigned int bx = static_cast<unsigned int>(x) >> 1;
+			const unsigned int by = static_cast<unsigned int>(y) >> 1;
+			return m_mutexBuffer[((bx * 73856093u) ^ (by * 19349663u)) & (k_numStripes - 1)].m_mutex;
+		}
+
+	private:
+		static constexpr unsigned int k_numStripes = 4096; //Note: must be power of 2
+
+		//Note: one lock per cache line to avoid false sharing
+		struct alignas(64) PaddedMutex { MutexType m_mutex; };
+		std::vector<PaddedMutex, tbb::cache_aligned_allocator<PaddedMutex>> m_mutexBuffer;
+	};
+
+	//Scratch buffers of sort-middle tile binning
+	class TRTileBinningCache final
+	{
+	public:
+		static constexpr int k_tileSize = 64;		//Screen tile size in pixels
+
+		//Screen space triangle overlapping a tile
+		struct BinnedTriangle
+		{
+			const TRShadingPipeline::VertexData *m_vertices;	//3 vertices
+			unsigned int m_primitiveId;							//(face index << 4) | index of the clipped triangle
+		};
+
+		//Screen space triangles (3 vertices per triangle) produced by each face
+		std::vector<std::vector<TRShadingPipeline::VertexData>> m_binnedFaces;
+		//Triangles overlapping each tile, in submission order
+		std::vector<std::vector<BinnedTriangle>> m_tileBins;
+		//Rasterized fragments of the tile being processed by each thread
+		tbb::enumerable_thread_specific<TRShadingPipeline::QuadFragmentStream> m_tileFragments;
+	};
+
+	//Visibility buffer of deferred rendering: the triangle visible at each sampling point.
+	//Note: id = ((drawId + 1) << 32) | primitiveId, and 0 indicates nothing visible
+	//Refs: Burns C A, Hunt W A. The visibility buffer: a cache-friendly approach to deferred shading[J]. 
+	//      Journal of Computer Graphics Techniques, 2013, 2(2): 55-69.
+	class TRVisibilityBuffer final
+	{
+	public:
+		//Visible part of a triangle within a 2x2 pixels block
+		struct QuadVisibility
+		{
+			uint64_t m_id;
+			glm::ivec2 m_pos;			//Screen space position of f0
+			unsigned int m_coverage;	//Bit (f * samplingNum + s)
+		};
+
+		void resize(const int &width, const int &height, const int &samplingNum);
+		void clear();
+
+		uint64_t read(const int &x, const int &y, const int &s) const { return m_ids[(y * m_width + x) * m_samplingNum + s]; }
+		void write(const int &x, const int &y, const int &s, const uint64_t &id) { m_ids[(y * m_width + x) * m_samplingNum + s] = id; }
+
+		static uint64_t packId(const int &drawId, const unsigned int &primitiveId)
+		{
+			return (static_cast<uint64_t>(drawId + 1) << 32) | primitiveId;
+		}
+		static int unpackDrawId(const uint64_t &id) { return static_cast<int>(id >> 32) - 1; }
+		static unsigned int unpackPrimitiveId(const uint64_t &id) { return static_cast<unsigned int>(id); }
+
+		//Gather the visible triangles of each 2x2 pixels block of tile [tileMin, tileMax], sorted by id
+		void gatherTileQuads(const int &tile, const glm::ivec2 &tileMin, const glm::ivec2 &tileMax);
+
+		int m_numDraws = 0;										//Draw id counter of a pass
+		std::vector<std::vector<QuadVisibility>> m_tileQuads;	//Visible triangles of each tile
+		std::vector<size_t> m_tileCursor;						//The first quad of each tile to be shaded
+
+	private:
+		int m_width = 0, m_height = 0;
+		int m_samplingNum = 4;
+		std::vector<uint64_t> m_ids;
+	};
+
 	class TRRenderer final
 	{
 	public:
@@ -31,9 +126,16 @@ namespace TinyRenderer
 		//Setting
 		void setViewMatrix(const glm::mat4 &view) { m_viewMatrix = view; }
 		void setModelMatrix(const glm::mat4 &model) { m_modelMatrix = model; }
-		void setProjectMatrix(const glm::mat4 &project, float near, float far) { m_projectMatrix = project;m_frustumNearFar = glm::vec2(near, far); }
+		void setProjectMatrix(const glm::mat4 &project, float near, float far);
 		void setShaderPipeline(TRShadingPipeline::ptr shader) { m_shaderHandler = shader; }
 		void setViewerPos(const glm::vec3 &viewer);
+		void setRenderingMode(TRRenderingMode mode) { m_renderingMode = mode; }
+		void setDepthPrePass(TRDepthPrePassMode mode) { m_depthPrePassMode = mode; }
+		//Note: the framebuffers are recreated if the sampling number or the depth format changes
+		void setMSAAMode(TRMSAAMode mode);
+		void setDepthFormat(TRDepthFormat format, TRReverseZMode reverseZ = TRReverseZMode::TR_REVERSE_Z_ENABLE);
+		//Snapping of the screen space positions to the grid of 2^-bits pixel, bits in [0, k_subPixelBits]
+		void setSubPixelPrecision(const int &bits) { m_subPixelBits = glm::clamp(bits, 0, k_subPixelBits); }
 
 		int addLightSource(TRLight::ptr lightSource);
 		TRLight::ptr getLightSource(const int &index);
@@ -48,20 +150,51 @@ namespace TinyRenderer
 		unsigned char* commitRenderedColorBuffer();
 
 		//Homogeneous space clipping - Sutherland Hodgeman algorithm
-		static std::vector<TRShadingPipeline::VertexData> clipingSutherlandHodgeman(
+		//Note: Varyings should be one of the precompiled interpolant layouts of TRShadingPipeline.
+		//      The clipped polygon is written to clipped[k_maxClippedVertices] and the number of its vertices is returned.
+		//      guardBand is the ndc extent of the x/y clipping planes, (1,1) -> clipping against the viewport
+		static constexpr int k_maxClippedVertices = 3 + 7;	//Each of 7 clipping planes adds one vertex at most
+		template<unsigned int Varyings>
+		static int clipingSutherlandHodgeman(
 			const TRShadingPipeline::VertexData &v0,
 			const TRShadingPipeline::VertexData &v1,
 			const TRShadingPipeline::VertexData &v2,
 			const float &near, 
-			const float &far);
+			const float &far,
+			const glm::vec2 &guardBand,
+			TRShadingPipeline::VertexData *clipped);
+
+		//Guard band: triangles within [-k_guardBandExtent, k_guardBandExtent] pixels skip the x/y clipping,
+		//and they are scissored to the screen by the rasterizer instead.
+		//Note: the fixed-point screen space positions (and their differences) in this range fit in 32 bits
+		static constexpr int k_guardBandExtent = 8192;
 
 	private:
 
+		//Passes of drawing a drawable mesh
+		enum TRRenderPass
+		{
+			TR_PASS_FORWARD,		//Depth testing, shading and writing at once
+			TR_PASS_DEPTH_ONLY,		//Depth pre-pass: only the depth of opaque drawables is written
+			TR_PASS_DEPTH_EQUAL,	//Opaque drawables are shaded where their depth equals the pre-pass one
+			TR_PASS_VISIBILITY,		//Only the depth and visibility buffer of opaque drawables are written
+			TR_PASS_MATERIAL,		//Opaque drawables are shaded where they are visible in the visibility buffer
+			TR_PASS_FORWARD_REST	//The drawables not deferred are rendered forward after the material pass
+		};
+
+		unsigned int renderDrawableMesh(const size_t &index, const TRRenderPass &pass);
+
+		void createFrameBuffers(const int &width, const int &height);
+
 		//Cliping auxiliary functions
-		static std::vector<TRShadingPipeline::VertexData> clipingSutherlandHodgemanAux(
-			const std::vector<TRShadingPipeline::VertexData> &polygon,
-			const int &axis, 
-			const int &side);
+		//Note: plane 0~5 -> g.x*w=x, g.x*w=-x, g.y*w=y, g.y*w=-y, w=z, w=-z, and plane 6 -> w=1e-5 (g: guard band)
+		template<unsigned int Varyings>
+		static int clipingSutherlandHodgemanAux(
+			const TRShadingPipeline::VertexData *polygon,
+			const int &numVerts,
+			const int &plane,
+			const glm::vec2 &guardBand,
+			TRShadingPipeline::VertexData *insidePolygon);
 
 	private:
 
@@ -73,15 +206,37 @@ namespace TinyRenderer
 		glm::mat4 m_viewMatrix = glm::mat4(1.0f);				//From world space  -> camera space
 		glm::mat4 m_projectMatrix = glm::mat4(1.0f);			//From camera space -> clip space
 		glm::mat4 m_viewportMatrix = glm::mat4(1.0f);			//From ndc space    -> screen space
+		glm::vec2 m_guardBand = glm::vec2(1.0f);				//Ndc extent of the guard band
+		int m_subPixelBits = k_subPixelBits;					//Sub-pixel precision of the vertex snapping
 
 		TRShadingState m_shadingState;
 
+		//Lighting environment
+		std::vector<TRLight::ptr> m_lights;
+		glm::vec3 m_viewerPos = glm::vec3(0.0f);
+		float m_exposure = 1.0f;
+
 		//Near plane & far plane
-		glm::vec2 m_frustumNearFar;
+		glm::vec2 m_frustumNearFar = glm::vec2(1.0f, 1000.0f);
 
 		//Shader pipeline handler
 		TRShadingPipeline::ptr m_shaderHandler = nullptr;
 
+		//Rasterization backend
+		TRRenderingMode m_renderingMode = TRRenderingMode::TR_RENDERING_PIPELINE;
+		TRDepthPrePassMode m_depthPrePassMode = TRDepthPrePassMode::TR_DEPTH_PREPASS_DISABLE;
+		TRMSAAMode m_msaaMode = TRMSAAMode::TR_MSAA_4X;
+		TRDepthFormat m_depthFormat = TRDepthFormat::TR_DEPTH_FORMAT_D32F;
+		TRReverseZMode m_reverseZMode = TRReverseZMode::TR_REVERSE_Z_ENABLE;
+		TRTileBinningCache m_tileBinningCache;
+		TRVisibilityBuffer m_visibilityBuffer;
+
+		//Per-renderer scratch state of pipeline rendering
+		int m_numTokens;
+		TRFrameBufferMutex m_framebufferMutex;
+		std::vector<TRShadingPipeline::QuadFragmentStream> m_fragmentCache;
+		std::vector<TRShadingPipeline::VertexData> m_shadedVertices;	//Post-transform vertex cache of a draw call
+
 		//Double buffers
 		TRFrameBuffer::ptr m_backBuffer;                      // The frame buffer that's goint to be written.
 		TRFrameBuffer::ptr m_frontBuffer;                     // The frame buffer that's goint to be displayed.
@@ -0,0 +1,51 @@
+#ifndef TRSIMD_H
+#define TRSIMD_H
+
+//SIMD kernels are only compiled for x86-64, with runtime dispatch between SSE2 and AVX2
+#if defined(__x86_64__) || defined(_M_X64)
+#define TR_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+//Note: MSVC allows intrinsics of any instruction set without target attributes
+#define TR_TARGET_AVX2
+#else
+#define TR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace TinyRenderer
+{
+#ifdef TR_SIMD_X86
+	inline bool isAVX2Supported()
+	{
+		//Note: CPU features would not change at runtime, hence detected once
+		static const bool supported = []()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7)
+				return false;
+			__cpuid(info, 1);
+			//OSXSAVE & AVX
+			if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+				return false;
+			//The OS should save the YMM registers
+			if ((_xgetbv(0) & 0x6) != 0x6)
+				return false;
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") != 0;
+#endif
+		}();
+		return supported;
+	}
+#else
+	inline bool isAVX2Supported() { return false; }
+#endif
+}
+
+#endif
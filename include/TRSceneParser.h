@@ -31,7 +31,7 @@ namespace TinyRenderer
 		TRDrawableMesh::ptr getEntity(const std::string &name);
 		int getLight(const std::string &name);
 
-		void parse(const std::string &path, TRRenderer::ptr renderer, bool generatedMipmap);
+		void parse(const std::string &path, TRRenderer::ptr renderer, bool generatedMipmap, bool compressedTexture = false);
 
 	private:
 		float parseFloat(std::string str) const;
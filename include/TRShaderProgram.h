@@ -13,6 +13,7 @@ namespace TinyRenderer
 
 		virtual ~TR3DShadingPipeline() = default;
 
+		virtual unsigned int getVaryingFlags() const override { return TR_VARYING_TEXCOORD; }
 		virtual void vertexShader(VertexData &vertex) const override;
 		virtual void fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const override;
@@ -27,6 +28,7 @@ namespace TinyRenderer
 
 		virtual ~TRDoNothingShadingPipeline() = default;
 
+		virtual unsigned int getVaryingFlags() const override { return TR_VARYING_TEXCOORD; }
 		virtual void vertexShader(VertexData &vertex) const override;
 		virtual void fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const override;
@@ -40,8 +42,12 @@ namespace TinyRenderer
 
 		virtual ~TRTextureShadingPipeline() = default;
 
+		virtual void vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+			const unsigned int &varyings) const override;
 		virtual void fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const override;
+		virtual void fragmentShaderQuad(const FragmentData *data, const unsigned int &mask, glm::vec4 *fragColor,
+			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const override;
 	};
 
 	class TRLODVisualizePipeline final : public TR3DShadingPipeline
@@ -52,6 +58,8 @@ namespace TinyRenderer
 
 		virtual ~TRLODVisualizePipeline() = default;
 
+		virtual void vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+			const unsigned int &varyings) const override;
 		virtual void fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const override;
 	};
@@ -63,6 +71,9 @@ namespace TinyRenderer
 
 		virtual ~TRPhongShadingPipeline() = default;
 
+		virtual unsigned int getVaryingFlags() const override { return TR_VARYING_POSITION | TR_VARYING_NORMAL | TR_VARYING_TEXCOORD; }
+		virtual void vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+			const unsigned int &varyings) const override;
 		virtual void fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const override;
 	};
@@ -74,8 +85,18 @@ namespace TinyRenderer
 
 		virtual ~TRBlinnPhongShadingPipeline() = default;
 
+		virtual unsigned int getVaryingFlags() const override { return TR_VARYING_POSITION | TR_VARYING_NORMAL | TR_VARYING_TEXCOORD; }
+		virtual void vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+			const unsigned int &varyings) const override;
 		virtual void fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const override;
+		virtual void fragmentShaderQuad(const FragmentData *data, const unsigned int &mask, glm::vec4 *fragColor,
+			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const override;
+
+	private:
+		//Lighting with the sampled textures
+		void lighting(const FragmentData &data, const glm::vec4 &difftexcolor, const glm::vec3 &speColor,
+			const glm::vec3 &glowColor, glm::vec4 &fragColor) const;
 	};
 
 	class TRBlinnPhongNormalMapShadingPipeline final : public TR3DShadingPipeline
@@ -85,9 +106,19 @@ namespace TinyRenderer
 
 		virtual ~TRBlinnPhongNormalMapShadingPipeline() = default;
 
+		virtual unsigned int getVaryingFlags() const override { return TR_VARYING_POSITION | TR_VARYING_NORMAL | TR_VARYING_TEXCOORD | TR_VARYING_TBN; }
 		virtual void vertexShader(VertexData &vertex) const override;
+		virtual void vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+			const unsigned int &varyings) const override;
 		virtual void fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const override;
+		virtual void fragmentShaderQuad(const FragmentData *data, const unsigned int &mask, glm::vec4 *fragColor,
+			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const override;
+
+	private:
+		//Lighting with the sampled textures, normalTexel is the texel of normal map (nullptr -> none)
+		void lighting(const FragmentData &data, const glm::vec4 &difftexcolor, const glm::vec3 &speColor,
+			const glm::vec3 &glowColor, const glm::vec4 *normalTexel, glm::vec4 &fragColor) const;
 	};
 
 	class TRAlphaBlendingShadingPipeline final : public TR3DShadingPipeline
@@ -97,8 +128,12 @@ namespace TinyRenderer
 
 		virtual ~TRAlphaBlendingShadingPipeline() = default;
 
+		virtual void vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+			const unsigned int &varyings) const override;
 		virtual void fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const override;
+		virtual void fragmentShaderQuad(const FragmentData *data, const unsigned int &mask, glm::vec4 *fragColor,
+			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const override;
 	};
 }
 
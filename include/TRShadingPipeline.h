@@ -8,38 +8,42 @@
 
 #include "TRLight.h"
 #include "TRTexture2D.h"
+#include "TRShadingState.h"
 #include "TRParallelWrapper.h"
 #include "TRPixelSampler.h"
 
 namespace TinyRenderer
 {
+	class TRFrameBuffer;
+	class TRVertex;
+
 	class TRShadingPipeline
 	{
 	public:
 		typedef std::shared_ptr<TRShadingPipeline> ptr;
 		
-		struct FragmentData;
 		struct VertexData
 		{
 			glm::vec3 m_pos;  //World space position
 			glm::vec3 m_nor;  //World space normal
 			glm::vec2 m_tex;	//World space texture coordinate
 			glm::vec4 m_cpos; //Clip space position
-			glm::ivec2 m_spos;//Screen space position
+			glm::ivec2 m_spos;//Screen space position (fixed-point with k_subPixelBits fractional bits)
 			glm::mat3 m_tbn;  //Tangent, bitangent, normal matrix
-			bool m_needInterpolatedTBN = false;
 			float m_rhw;
 
 			VertexData() = default;
 			VertexData(const glm::ivec2 &screenPos) : m_spos(screenPos) {}
 
 			//Linear interpolation
+			//Note: only the clip space position and the declared varyings are interpolated
+			template<unsigned int Varyings>
 			static VertexData lerp(const VertexData &v0, const VertexData &v1, float frac);
 
-			static FragmentData barycentricLerp(const VertexData &v0, const VertexData &v1, const VertexData &v2, const glm::vec3 &w);
 			static float barycentricLerp(const float &d0, const float &d1, const float &d2, const glm::vec3 &w);
 
 			//Perspective correction for interpolation
+			template<unsigned int Varyings>
 			static void prePerspCorrection(VertexData &v);
 		};
 
@@ -51,22 +55,14 @@ namespace TinyRenderer
 			glm::vec2 m_tex;	//World space texture coordinate
 			glm::ivec2 m_spos;//Screen space position
 			glm::mat3 m_tbn;  //Tangent, bitangent, normal matrix
-			float m_rhw;
-			
-			//MSAA Mask
-			//Note: each sampling point should have its own depth
-			TRMaskPixelSampler m_coverage = 0;
-			TRDepthPixelSampler m_coverageDepth = 0.0f;
 
 			FragmentData() = default;
 			FragmentData(const glm::ivec2 &screenPos) : m_spos(screenPos) {}
-
-			static void aftPrespCorrection(FragmentData &v);
-
 		};
 
-		//2x2 fragments block for calculating dFdx and dFdy.
-		class QuadFragments
+		//Structure-of-arrays stream of 2x2 fragments blocks for calculating dFdx and dFdy.
+		//Note: only the varyings declared by the pipeline are stored, and they have been perspective corrected.
+		class QuadFragmentStream
 		{
 		public:
 			/*************************************
@@ -76,23 +72,70 @@ namespace TinyRenderer
 			 *   f0 -> (x+0, y+0), f1 -> (x+1,y+0 )
 			 *   f2 -> (x+0, y+1), f3 -> (x+1,y+1)
 			 ************************************/
-			FragmentData m_fragments[4];
+			static_assert(4 * k_maxSamplingNum <= 32, "Coverage of a 2x2 block should fit in 32 bits");
+
+			void setVaryings(const unsigned int &varyings) { m_varyings = varyings; }
+			unsigned int getVaryings() const { return m_varyings; }
+
+			//Number of MSAA sampling points per fragment
+			//Note: should be set before appending blocks, and match the rasterizer and framebuffer
+			void setSamplingNum(const int &samplingNum) 
+			{ 
+				m_samplingNum = samplingNum; 
+				m_fragmentMask = (1u << samplingNum) - 1;
+			}
+			int getSamplingNum() const { return m_samplingNum; }
+
+			size_t size() const { return m_quadPos.size(); }
+			bool empty() const { return m_quadPos.empty(); }
+			void reserve(const size_t &numQuads);
+			void clear();
+
+			//Append a 2x2 block with coverage bit (f * samplingNum + s) and 4 * samplingNum depths
+			//Note: returns the index of the first fragment of the block
+			size_t appendQuad(const glm::ivec2 &pos, const unsigned int &coverage, const float *coverageDepth);
+
+			//Barycentric interpolation and perspective correction of the declared varyings
+			//Note: Varyings should be the same as the ones set by setVaryings()
+			template<unsigned int Varyings>
+			void interpolate(const size_t &index, const VertexData &v0, const VertexData &v1, 
+				const VertexData &v2, const glm::vec3 &w);
+
+			//Screen space position of f0 in block q
+			const glm::ivec2 &getQuadPos(const size_t &q) const { return m_quadPos[q]; }
+
+			//Coverage mask and depth of the sampling points of fragment f in block q
+			unsigned int getCoverage(const size_t &q, const int &f) const 
+			{ 
+				return (m_coverage[q] >> (f * m_samplingNum)) & m_fragmentMask; 
+			}
+			const float *getCoverageDepth(const size_t &q, const int &f) const 
+			{ 
+				return &m_coverageDepth[(q * 4 + f) * m_samplingNum]; 
+			}
+
+			//Gather the declared varyings of fragment f in block q
+			void fetchFragment(const size_t &q, const int &f, FragmentData &data) const;
 
 			//Forward differencing
 			//Note: Need to handle the boundary condition.
-			inline float dUdx() const { return m_fragments[1].m_tex.x - m_fragments[0].m_tex.x; }
-			inline float dUdy() const { return m_fragments[2].m_tex.x - m_fragments[0].m_tex.x; }
-			inline float dVdx() const { return m_fragments[1].m_tex.y - m_fragments[0].m_tex.y;	}
-			inline float dVdy() const { return m_fragments[2].m_tex.y - m_fragments[0].m_tex.y; }
-		
-			//Perspective correction restore
-			inline void aftPrespCorrectionForBlocks()
-			{
-				TRShadingPipeline::FragmentData::aftPrespCorrection(m_fragments[0]);
-				TRShadingPipeline::FragmentData::aftPrespCorrection(m_fragments[1]);
-				TRShadingPipeline::FragmentData::aftPrespCorrection(m_fragments[2]);
-				TRShadingPipeline::FragmentData::aftPrespCorrection(m_fragments[3]);
-			}
+			glm::vec2 dUVdx(const size_t &q) const;
+			glm::vec2 dUVdy(const size_t &q) const;
+
+		private:
+			unsigned int m_varyings = 0;
+			int m_samplingNum = 4;
+			unsigned int m_fragmentMask = 0xf;
+
+			std::vector<glm::ivec2> m_quadPos;		//Screen space position of f0
+			std::vector<unsigned int> m_coverage;	//MSAA coverage bitmask of a block
+			std::vector<float> m_coverageDepth;		//Note: each sampling point should have its own depth
+
+			//Declared varyings (4 per block)
+			std::vector<glm::vec3> m_pos;
+			std::vector<glm::vec3> m_nor;
+			std::vector<glm::vec2> m_tex;
+			std::vector<glm::mat3> m_tbn;
 		};
 
 		virtual ~TRShadingPipeline() = default;
@@ -119,43 +162,109 @@ namespace TinyRenderer
 		void setGlowTexId(const int &id) { m_glowTexId = id; }
 		void setShininess(const float &shininess) { m_shininess = shininess; }
 
+		//Varyings needed by the fragment shader (combination of TRVaryingFlag)
+		//Note: it should be a compile-time constant of the pipeline, which is rounded up to 
+		//      one of the precompiled interpolant layouts below by getVaryingsLayout()
+		virtual unsigned int getVaryingFlags() const { return k_varyingsLighting; }
+
+		//Precompiled interpolant layouts
+		static constexpr unsigned int k_varyingsNone = 0;	//Depth only
+		static constexpr unsigned int k_varyingsTexcoord = TR_VARYING_TEXCOORD;
+		static constexpr unsigned int k_varyingsLighting = TR_VARYING_POSITION | TR_VARYING_NORMAL | TR_VARYING_TEXCOORD;
+		static constexpr unsigned int k_varyingsAll = k_varyingsLighting | TR_VARYING_TBN;
+		static unsigned int getVaryingsLayout(const unsigned int &varyings);
+
 		//Shaders
 		virtual void vertexShader(VertexData &vertex) const = 0;
+		//Vertex shader of n vertices fetched from the vertex buffer at once
+		//Note: the default one calls vertexShader() per vertex, the pipelines could override it with SIMD 
+		//      implementations which should produce the same results as vertexShader(), and only the varyings
+		//      of the interpolant layout varyings (e.g. k_varyingsNone -> clip space position) are needed
+		virtual void vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, const unsigned int &varyings) const;
 		virtual void fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const = 0;
+		//Fragment shader of a 2x2 fragments block at once, only the fragments f in mask (bit f) should be shaded
+		//Note: the helper fragments of data are interpolated as well, hence the pipelines could override it 
+		//      with texture2DQuad() which produces the same results as fragmentShader()
+		virtual void fragmentShaderQuad(const FragmentData *data, const unsigned int &mask, glm::vec4 *fragColor,
+			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const;
 
 		//Rasterization
+		//Note: Varyings should be one of the precompiled interpolant layouts, Samples should be one of TRMSAAMode
+		//      and equal to the sampling number of rasterized_fragments,
+		//      and the blocks occluded by the hierarchical depth of hizBuffer are culled (nullptr -> disabled),
+		//      i.e. the blocks of which all samples would fail depthFunc
+		template<unsigned int Varyings, int Samples>
 		static void rasterizeFillEdgeFunction(
 			const VertexData &v0,
 			const VertexData &v1,
 			const VertexData &v2,
 			const unsigned int &screenWidth,
 			const unsigned int &screenHeight,
-			std::vector<QuadFragments> &rasterized_points);
+			QuadFragmentStream &rasterized_fragments,
+			const TRFrameBuffer *hizBuffer = nullptr,
+			const TRDepthFunc &depthFunc = TRDepthFunc::TR_DEPTH_FUNC_GREATER);
 
-		//Textures and lights setting
+		//Rasterization restricted to the region [regionMin, regionMax] of screen (e.g. a screen tile)
+		template<unsigned int Varyings, int Samples>
+		static void rasterizeFillEdgeFunction(
+			const VertexData &v0,
+			const VertexData &v1,
+			const VertexData &v2,
+			const glm::ivec2 &regionMin,
+			const glm::ivec2 &regionMax,
+			QuadFragmentStream &rasterized_fragments,
+			const TRFrameBuffer *hizBuffer = nullptr,
+			const TRDepthFunc &depthFunc = TRDepthFunc::TR_DEPTH_FUNC_GREATER);
+
+		//Reconstruction of the 2x2 fragments block at pos (i.e. f0) from a rasterized triangle (e.g. visibility buffer)
+		//Note: the interpolated varyings are identical to the ones produced by rasterizeFillEdgeFunction()
+		template<unsigned int Varyings>
+		static void reconstructQuadFragments(
+			const VertexData &v0,
+			const VertexData &v1,
+			const VertexData &v2,
+			const glm::ivec2 &pos,
+			const unsigned int &coverage,
+			const float *coverageDepth,
+			QuadFragmentStream &fragments);
+
+		//Textures setting
 		static int uploadTexture2D(TRTexture2D::ptr tex);
 		static TRTexture2D::ptr getTexture2D(int index);
-		static int addLight(TRLight::ptr lightSource);
-		static TRLight::ptr getLight(int index);
-		static void setExposure(const float &exposure) { m_exposure = exposure; }
-		static void setViewerPos(const glm::vec3 &viewer) { m_viewerPos = viewer; }
+
+		//Lighting setting
+		//Note: the lights, exposure and viewer belong to the renderer that drives this pipeline
+		void setLights(const std::vector<TRLight::ptr> &lights) { m_lights = lights; }
+		void setExposure(const float &exposure) { m_exposure = exposure; }
+		void setViewerPos(const glm::vec3 &viewer) { m_viewerPos = viewer; }
 
 		//Texture sampling
 		static glm::vec4 texture2D(const unsigned int &id, const glm::vec2 &uv, 
 			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy);
+		//Texture sampling of the 4 uv coordinates of a 2x2 fragments block, with the lod computed once
+		static void texture2DQuad(const unsigned int &id, const FragmentData *data, 
+			const glm::vec2 &dUVdx, const glm::vec2 &dUVdy, glm::vec4 *texels);
 
 	protected:
 
+		//Local space -> world space -> clip space transformation of n vertices, 8 vertices in SoA form at once with AVX2.
+		//Note: the normal (and the tangent and bitangent of TR_VARYING_TBN) is transformed by m_invTransModelMatrix and normalized,
+		//      the attributes out of the interpolant layout varyings are skipped (e.g. depth only passes)
+		void transformVerticesBatch(const TRVertex *in, const size_t &n, VertexData *out, const unsigned int &varyings) const;
+
 		glm::mat4 m_modelMatrix = glm::mat4(1.0f);
 		glm::mat3 m_invTransModelMatrix = glm::mat3(1.0f);
 		glm::mat4 m_viewProjectMatrix = glm::mat4(1.0f);
 
-		//Global shading setttings
-		static std::vector<TRTexture2D::ptr> m_globalTextureUnits;
-		static std::vector<TRLight::ptr> m_lights;
-		static glm::vec3 m_viewerPos;
-		static float m_exposure;
+		//Global texture units shared by all of pipelines
+		//Note: concurrent vector for thread-safe uploading while other renderers are drawing
+		static tbb::concurrent_vector<TRTexture2D::ptr> m_globalTextureUnits;
+
+		//Lighting settings
+		std::vector<TRLight::ptr> m_lights;
+		glm::vec3 m_viewerPos = glm::vec3(0.0f);
+		float m_exposure = 1.0f;
 
 		//Material setting
 		glm::vec3 m_kA = glm::vec3(0.0f);
@@ -21,6 +21,15 @@ namespace TinyRenderer
 		TR_LINEAR
 	};
 
+	//Block compression of texture, the texels are decoded from 4x4 blocks on sampling
+	enum TRTextureCompressionMode
+	{
+		TR_TEXTURE_COMPRESSION_DISABLE,	//Uncompressed texel format (see TRTextureFormat)
+		TR_TEXTURE_COMPRESSION_COLOR,	//BC1 (4bpp) for opaque images, BC3 (8bpp) for images with alpha
+		TR_TEXTURE_COMPRESSION_GRAY,	//BC4 (4bpp) of luminance, e.g. specular maps
+		TR_TEXTURE_COMPRESSION_NORMAL	//BC5 (8bpp) of xy, z is reconstructed, e.g. tangent space normal maps
+	};
+
 	//Cull back face mode
 	enum TRCullFaceMode
 	{
@@ -41,6 +50,20 @@ namespace TinyRenderer
 		TR_DEPTH_WRITE_ENABLE
 	};
 
+	//Depth comparison of depth testing
+	//Note: reversed z, the greater depth (i.e. 1/w) is closer
+	enum TRDepthFunc
+	{
+		TR_DEPTH_FUNC_GREATER,
+		TR_DEPTH_FUNC_EQUAL
+	};
+
+	enum TRColorWriteMode
+	{
+		TR_COLOR_WRITE_DISABLE,
+		TR_COLOR_WRITE_ENABLE
+	};
+
 	enum TRLightingMode
 	{
 		TR_LIGHTING_DISABLE,
@@ -54,12 +77,64 @@ namespace TinyRenderer
 		TR_ALPHA_TO_COVERAGE
 	};
 
+	//Rasterization backend of renderer
+	enum TRRenderingMode
+	{
+		TR_RENDERING_PIPELINE,		//Faces streamed through a parallel pipeline, framebuffer guarded by mutex
+		TR_RENDERING_TILE_BINNING,	//Sort-middle: faces binned into screen tiles, each tile owned by one thread
+		TR_RENDERING_VISIBILITY_BUFFER	//Deferred: tile binned visibility buffer, then materials shaded per visible sample
+	};
+
+	//Depth pre-pass of renderer
+	enum TRDepthPrePassMode
+	{
+		TR_DEPTH_PREPASS_DISABLE,	//Fragments passing early-z are shaded at the time they arrive
+		TR_DEPTH_PREPASS_ENABLE		//Depth of opaque drawables is laid down first, then only the visible fragments are shaded
+	};
+
+	//Multi sampling anti-aliasing of renderer (the number of sampling points per pixel)
+	enum TRMSAAMode
+	{
+		TR_MSAA_1X = 1,		//No anti-aliasing, e.g. for previews
+		TR_MSAA_2X = 2,
+		TR_MSAA_4X = 4,
+		TR_MSAA_8X = 8
+	};
+
+	//Depth buffer format of renderer
+	//Note: the unorm formats store the normalized depth near/w, trading precision for bandwidth
+	enum TRDepthFormat
+	{
+		TR_DEPTH_FORMAT_D16,	//16-bit unorm, e.g. for previews
+		TR_DEPTH_FORMAT_D24,	//24-bit unorm (padded to 32 bits)
+		TR_DEPTH_FORMAT_D32F	//32-bit float
+	};
+
+	//Reverse-Z: the closer is stored as the greater, which matches the distribution of float precision
+	//Note: the depth testing is the same either way (see TRDepthFunc), only the precision of the storage differs
+	enum TRReverseZMode
+	{
+		TR_REVERSE_Z_DISABLE,
+		TR_REVERSE_Z_ENABLE
+	};
+
+	//Varying attributes interpolated from vertices to fragments
+	enum TRVaryingFlag
+	{
+		TR_VARYING_POSITION = 1 << 0,	//World space position
+		TR_VARYING_NORMAL   = 1 << 1,	//World space normal
+		TR_VARYING_TEXCOORD = 1 << 2,	//Texture coordinate
+		TR_VARYING_TBN      = 1 << 3	//Tangent, bitangent, normal matrix
+	};
+
 	class TRShadingState
 	{
 	public:
 		TRCullFaceMode m_trCullFaceMode		 = TRCullFaceMode::TR_CULL_BACK;
 		TRDepthTestMode m_trDepthTestMode		 = TRDepthTestMode::TR_DEPTH_TEST_ENABLE;
 		TRDepthWriteMode m_trDepthWriteMode	 = TRDepthWriteMode::TR_DEPTH_WRITE_ENABLE;
+		TRDepthFunc m_trDepthFunc				 = TRDepthFunc::TR_DEPTH_FUNC_GREATER;
+		TRColorWriteMode m_trColorWriteMode	 = TRColorWriteMode::TR_COLOR_WRITE_ENABLE;
 		TRAlphaBlendingMode m_trAlphaBlendMode = TRAlphaBlendingMode::TR_ALPHA_DISABLE;
 	};
 
@@ -28,21 +28,61 @@ namespace TinyRenderer
 		//Sampling options setting
 		void setWarpingMode(TRTextureWarpMode mode);
 		void setFilteringMode(TRTextureFilterMode mode);
+		//Anisotropic filtering: up to maxAnisotropy trilinear taps along the major axis of the footprint
+		//Note: only works with mipmap, 1 -> isotropic (i.e. trilinear) filtering
+		void setMaxAnisotropy(const int &maxAnisotropy);
+		int getMaxAnisotropy() const { return m_maxAnisotropy; }
+		static constexpr int k_maxAnisotropy = 16;
+		//Texel format of the uncompressed levels, chosen from the image on loading by default: 
+		//R8 for opaque gray images, RGBA16F for HDR images and RGBA8 for the others
+		//Note: should be called before loadTextureFromFile()
+		void setTexelFormat(TRTextureFormat format);
+		TRTextureFormat getTexelFormat() const { return m_texelFormat; }
 
 		bool loadTextureFromFile(
 			const std::string &filepath,
 			TRTextureWarpMode warpMode = TRTextureWarpMode::TR_REPEAT,
-			TRTextureFilterMode filterMode = TRTextureFilterMode::TR_LINEAR);
+			TRTextureFilterMode filterMode = TRTextureFilterMode::TR_LINEAR,
+			TRTextureCompressionMode compressionMode = TRTextureCompressionMode::TR_TEXTURE_COMPRESSION_DISABLE);
 
 		//Sampling according to the given uv coordinate
 		glm::vec4 sample(const glm::vec2 &uv, const float &level = 0.0f) const;
 
+		//Sampling the 4 uv coordinates of a 2x2 fragments block at the same level
+		//Note: warpping, level selection and layout dispatch are done once for the block, and the
+		//      4 uv coordinates are warpped and filtered together with SIMD.
+		void sampleQuad(const glm::vec2 *uv, const float &level, glm::vec4 *texels) const;
+
+		//Sampling with the screen space derivatives of uv, which select the mipmap level and 
+		//the anisotropic taps (shared by the 2x2 fragments block for sampleQuad)
+		glm::vec4 sample(const glm::vec2 &uv, const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const;
+		void sampleQuad(const glm::vec2 *uv, const glm::vec2 &dUVdx, const glm::vec2 &dUVdy, glm::vec4 *texels) const;
+
 	private:
 		//Auxiliary functions
-		void readPixel(const std::uint16_t &u, const std::uint16_t &v, unsigned char &r, 
-			unsigned char &g, unsigned char &b, unsigned char &a, const int level = 0) const;
-
-		void generateMipmap(unsigned char *pixels, int width, int height, int channel);
+		//Mipmap level of the footprint given by the screen space derivatives of uv, and the
+		//number of anisotropic taps (returned) spaced along axis (in uv)
+		int calculateFootprint(const glm::vec2 &dUVdx, const glm::vec2 &dUVdy, float &level, glm::vec2 &axis) const;
+
+		//Narrowest texel format holding the given 8-bit image
+		TRTextureFormat selectTexelFormat(const unsigned char *pixels, const int &nPixels, const int &channel) const;
+
+		//Note: T is unsigned char or float (HDR), the pixels keep the channels of image
+		template<typename T>
+		void generateMipmap(T *pixels, int width, int height, int channel);
+		//Texture holder of a level, layout is replaced by the block compressed one if compression is enabled
+		template<typename T>
+		TRTextureHolder::ptr createTextureHolder(const T *data, int width, int height, int channel,
+			TRTextureLayout layout) const;
+
+		//Filtering at the given level, dispatched once to the sampler specialized on its layout
+		glm::vec4 sampleLevel(const unsigned int &level, const glm::vec2 &uv) const;
+		template<typename Holder>
+		glm::vec4 filterLevel(const Holder &texture, const glm::vec2 &uv) const;
+		//Filtering the 4 warpped uv coordinates (u[4], v[4]) at the given level
+		void filterQuadLevel(const unsigned int &level, const float *u, const float *v, glm::vec4 *texels) const;
+		template<typename Holder>
+		void filterQuad(const Holder &texture, const float *u, const float *v, glm::vec4 *texels) const;
 
 	private:
 		bool m_generateMipmap = false;
@@ -50,6 +90,11 @@ namespace TinyRenderer
 
 		TRTextureWarpMode m_warpMode;
 		TRTextureFilterMode m_filteringMode;
+		int m_maxAnisotropy = 1;
+		TRTextureCompressionMode m_compressionMode = TRTextureCompressionMode::TR_TEXTURE_COMPRESSION_DISABLE;
+		TRTextureLayout m_compressedLayout = TRTextureLayout::TR_TEXTURE_LAYOUT_BC1;
+		bool m_autoTexelFormat = true;
+		TRTextureFormat m_texelFormat = TRTextureFormat::TR_TEXTURE_FORMAT_RGBA8;
 
 		friend class TRTexture2DSampler;
 	};
@@ -59,8 +104,20 @@ namespace TinyRenderer
 	public:
 
 		//Sampling algorithm
-		static glm::vec4 textureSamplingNearest(TRTextureHolder::ptr texture, glm::vec2 uv);
-		static glm::vec4 textureSamplingBilinear(TRTextureHolder::ptr texture, glm::vec2 uv);
+		//Note: Holder should be one of the final texture holders, whose texel fetching is inlined
+		template<typename Holder>
+		static glm::vec4 textureSamplingNearest(const Holder &texture, const glm::vec2 &uv);
+		template<typename Holder>
+		static glm::vec4 textureSamplingBilinear(const Holder &texture, const glm::vec2 &uv);
+
+		//Sampling of 4 warpped uv coordinates (u[4], v[4]) at once
+		template<typename Holder>
+		static void textureSamplingNearestQuad(const Holder &texture, const float *u, const float *v, glm::vec4 *texels);
+		template<typename Holder>
+		static void textureSamplingBilinearQuad(const Holder &texture, const float *u, const float *v, glm::vec4 *texels);
+
+		//Texture warpping of a uv coordinate component
+		static float warpCoordinate(const float &t, const TRTextureWarpMode &mode);
 	};
 }
 
@@ -1,46 +1,236 @@
 #ifndef TRTEXTURE_HOLDER_H
 #define TRTEXTURE_HOLDER_H
 
+#include <cmath>
+#include <vector>
 #include <memory>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "glm/glm.hpp"
 
 namespace TinyRenderer
 {
 	//Texture memory layout
+	enum TRTextureLayout
+	{
+		TR_TEXTURE_LAYOUT_LINEAR,
+		TR_TEXTURE_LAYOUT_TILING,
+		TR_TEXTURE_LAYOUT_ZCURVE_TILING,
+		//Block compressed layouts
+		TR_TEXTURE_LAYOUT_BC1,	//RGB
+		TR_TEXTURE_LAYOUT_BC3,	//RGBA
+		TR_TEXTURE_LAYOUT_BC4,	//R
+		TR_TEXTURE_LAYOUT_BC5	//RG
+	};
+
+	//Texel format of the uncompressed layouts
+	//Note: the texels are fetched as rgba in [0,1] (float formats are not clamped)
+	enum TRTextureFormat
+	{
+		TR_TEXTURE_FORMAT_R8,		//8bpp gray, fetched as (r,r,r,1)
+		TR_TEXTURE_FORMAT_RG8,		//16bpp two channels, fetched as (r,g,0,1)
+		TR_TEXTURE_FORMAT_RGB565,	//16bpp opaque color
+		TR_TEXTURE_FORMAT_RGBA8,	//32bpp color
+		TR_TEXTURE_FORMAT_RGBA16F	//64bpp half float color, e.g. HDR environment maps
+	};
+
 	class TRTextureHolder
 	{
 	public:
 		typedef std::shared_ptr<TRTextureHolder> ptr;
 
-		TRTextureHolder(std::uint16_t width, std::uint16_t height);
+		TRTextureHolder(std::uint16_t width, std::uint16_t height, TRTextureLayout layout, 
+			TRTextureFormat format = TRTextureFormat::TR_TEXTURE_FORMAT_RGBA8);
 		virtual ~TRTextureHolder();
 
 		std::uint16_t getWidth() const { return m_width; }
 		std::uint16_t getHeight() const { return m_height; }
+		TRTextureLayout getLayout() const { return m_layout; }
+		TRTextureFormat getFormat() const { return m_format; }
+
+		static int getBytesPerTexel(const TRTextureFormat &format);
 
-		virtual std::uint32_t read(const std::uint16_t &x, const std::uint16_t &y) const;
-		virtual void read(const std::uint16_t &x, const std::uint16_t &y, unsigned char &r, unsigned char &g,
-			unsigned char &b, unsigned char &a) const;
+		//Texel of (x,y) as rgba
+		virtual glm::vec4 read(const std::uint16_t &x, const std::uint16_t &y) const;
 		
 	protected:
 		std::uint16_t m_width, m_height;
-		std::uint32_t *m_data;//32bpp texture format (RGBA)
+		unsigned char *m_data;//Texels in m_format
+		TRTextureLayout m_layout;
+		TRTextureFormat m_format;
+
+		//Decoding of the texel at index of data
+		template<TRTextureFormat Format>
+		static glm::vec4 decodeTexel(const unsigned char *data, const unsigned int &index);
+		glm::vec4 fetchTexel(const unsigned int &index) const;
+
+		//Gather the texels of a 2x2 footprint from its separable row and column offsets
+		//Note: p0 -> (x0,y0), p1 -> (x1,y0), p2 -> (x0,y1), p3 -> (x1,y1), the format is dispatched once
+		void gatherQuad(const unsigned int &col0, const unsigned int &col1, const unsigned int &row0,
+			const unsigned int &row1, glm::vec4 *texels) const;
+		template<TRTextureFormat Format>
+		void gatherQuadFormat(const unsigned int &col0, const unsigned int &col1, const unsigned int &row0,
+			const unsigned int &row1, glm::vec4 *texels) const
+		{
+			texels[0] = decodeTexel<Format>(m_data, row0 + col0);
+			texels[1] = decodeTexel<Format>(m_data, row0 + col1);
+			texels[2] = decodeTexel<Format>(m_data, row1 + col0);
+			texels[3] = decodeTexel<Format>(m_data, row1 + col1);
+		}
 
-		void loadTexture(const unsigned int &nElements, unsigned char *data, const std::uint16_t &width, 
+		//Note: data is the image of width x height with 1 (gray), 2 (gray, alpha), 3 (RGB) or 4 (RGBA) channels, 
+		//      T is unsigned char ([0,255]) or float (HDR)
+		template<typename T>
+		void loadTexture(const unsigned int &nElements, const T *data, const std::uint16_t &width, 
 			const std::uint16_t &height, const int &channel);
 		virtual unsigned int xyToIndex(const std::uint16_t &x, const std::uint16_t &y) const = 0;
 		void freeTexture();
+
+		//Conversions of the channels of image
+		static float unorm8ToFloat(const unsigned char &v) { return v * (1.0f / 255.0f); }
+		static unsigned char floatToUnorm8(const float &v) { return (unsigned char)(glm::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f); }
+		static unsigned char toUnorm8(const unsigned char &v) { return v; }
+		static unsigned char toUnorm8(const float &v) { return floatToUnorm8(v); }
+		static float toFloat(const unsigned char &v) { return unorm8ToFloat(v); }
+		static float toFloat(const float &v) { return v; }
+
+		//32bpp RGBA texel (r in the highest byte) -> [0,1]
+		static glm::vec4 unpackRGBA8(const std::uint32_t &texel)
+		{
+			static constexpr float denom = 1.0f / 255.0f;
+			return glm::vec4((texel >> 24) & 0xFF, (texel >> 16) & 0xFF, (texel >> 8) & 0xFF, texel & 0xFF) * denom;
+		}
+
+		//IEEE 754 half float conversions (round to nearest even)
+		//Refs: https://fgiesen.wordpress.com/2012/03/28/half-to-float-done-quic/
+		static float halfToFloat(const std::uint16_t &h)
+		{
+			static constexpr std::uint32_t shiftedExp = 0x7C00u << 13;
+			std::uint32_t bits = (h & 0x7FFFu) << 13;
+			const std::uint32_t exp = bits & shiftedExp;
+			bits += (127u - 15u) << 23;
+			float f;
+			if (exp == shiftedExp)
+			{
+				//Inf/NaN
+				bits += (128u - 16u) << 23;
+				std::memcpy(&f, &bits, sizeof(float));
+			}
+			else if (exp == 0)
+			{
+				//Zero/denormal: renormalized by the float unit
+				bits += 1u << 23;
+				std::memcpy(&f, &bits, sizeof(float));
+				f -= 6.103515625e-05f;//2^-14
+			}
+			else
+			{
+				std::memcpy(&f, &bits, sizeof(float));
+			}
+			return (h & 0x8000u) ? -f : f;
+		}
+		static std::uint16_t floatToHalf(const float &value);
 	};
 
+	template<>
+	inline glm::vec4 TRTextureHolder::decodeTexel<TR_TEXTURE_FORMAT_R8>(const unsigned char *data, const unsigned int &index)
+	{
+		const float r = unorm8ToFloat(data[index]);
+		return glm::vec4(r, r, r, 1.0f);
+	}
+
+	template<>
+	inline glm::vec4 TRTextureHolder::decodeTexel<TR_TEXTURE_FORMAT_RG8>(const unsigned char *data, const unsigned int &index)
+	{
+		const unsigned char *texel = &data[index * 2];
+		return glm::vec4(unorm8ToFloat(texel[0]), unorm8ToFloat(texel[1]), 0.0f, 1.0f);
+	}
+
+	template<>
+	inline glm::vec4 TRTextureHolder::decodeTexel<TR_TEXTURE_FORMAT_RGB565>(const unsigned char *data, const unsigned int &index)
+	{
+		const std::uint16_t texel = reinterpret_cast<const std::uint16_t*>(data)[index];
+		return glm::vec4(((texel >> 11) & 31) * (1.0f / 31.0f), ((texel >> 5) & 63) * (1.0f / 63.0f), 
+			(texel & 31) * (1.0f / 31.0f), 1.0f);
+	}
+
+	template<>
+	inline glm::vec4 TRTextureHolder::decodeTexel<TR_TEXTURE_FORMAT_RGBA8>(const unsigned char *data, const unsigned int &index)
+	{
+		const unsigned char *texel = &data[index * 4];
+		return glm::vec4(texel[0], texel[1], texel[2], texel[3]) * (1.0f / 255.0f);
+	}
+
+	template<>
+	inline glm::vec4 TRTextureHolder::decodeTexel<TR_TEXTURE_FORMAT_RGBA16F>(const unsigned char *data, const unsigned int &index)
+	{
+		const std::uint16_t *texel = &reinterpret_cast<const std::uint16_t*>(data)[index * 4];
+		return glm::vec4(halfToFloat(texel[0]), halfToFloat(texel[1]), halfToFloat(texel[2]), halfToFloat(texel[3]));
+	}
+
+	inline glm::vec4 TRTextureHolder::fetchTexel(const unsigned int &index) const
+	{
+		switch (m_format)
+		{
+		case TRTextureFormat::TR_TEXTURE_FORMAT_R8:		 return decodeTexel<TR_TEXTURE_FORMAT_R8>(m_data, index);
+		case TRTextureFormat::TR_TEXTURE_FORMAT_RG8:	 return decodeTexel<TR_TEXTURE_FORMAT_RG8>(m_data, index);
+		case TRTextureFormat::TR_TEXTURE_FORMAT_RGB565:	 return decodeTexel<TR_TEXTURE_FORMAT_RGB565>(m_data, index);
+		case TRTextureFormat::TR_TEXTURE_FORMAT_RGBA16F: return decodeTexel<TR_TEXTURE_FORMAT_RGBA16F>(m_data, index);
+		default:										 return decodeTexel<TR_TEXTURE_FORMAT_RGBA8>(m_data, index);
+		}
+	}
+
+	inline void TRTextureHolder::gatherQuad(const unsigned int &col0, const unsigned int &col1, const unsigned int &row0,
+		const unsigned int &row1, glm::vec4 *texels) const
+	{
+		switch (m_format)
+		{
+		case TRTextureFormat::TR_TEXTURE_FORMAT_R8:
+			gatherQuadFormat<TR_TEXTURE_FORMAT_R8>(col0, col1, row0, row1, texels);
+			break;
+		case TRTextureFormat::TR_TEXTURE_FORMAT_RG8:
+			gatherQuadFormat<TR_TEXTURE_FORMAT_RG8>(col0, col1, row0, row1, texels);
+			break;
+		case TRTextureFormat::TR_TEXTURE_FORMAT_RGB565:
+			gatherQuadFormat<TR_TEXTURE_FORMAT_RGB565>(col0, col1, row0, row1, texels);
+			break;
+		case TRTextureFormat::TR_TEXTURE_FORMAT_RGBA16F:
+			gatherQuadFormat<TR_TEXTURE_FORMAT_RGBA16F>(col0, col1, row0, row1, texels);
+			break;
+		default:
+			gatherQuadFormat<TR_TEXTURE_FORMAT_RGBA8>(col0, col1, row0, row1, texels);
+			break;
+		}
+	}
+
 	//Linear layout
 	class TRLinearTextureHolder final : public TRTextureHolder
 	{
 	public:
 		typedef std::shared_ptr<TRLinearTextureHolder> ptr;
 
-		TRLinearTextureHolder(unsigned char *data, std::uint16_t width, std::uint16_t height, int channel);
+		//Note: the texels are converted from data to the given format
+		template<typename T>
+		TRLinearTextureHolder(const T *data, std::uint16_t width, std::uint16_t height, int channel, 
+			TRTextureFormat format = TRTextureFormat::TR_TEXTURE_FORMAT_RGBA8);
 		virtual ~TRLinearTextureHolder() = default;
 
+		//Non-virtual texel fetching
+		//Note: please guarantee that x and y are in [0,width-1],[0,height-1] respectively
+		glm::vec4 fetch(const std::uint16_t &x, const std::uint16_t &y) const { return fetchTexel(rowOffset(y) + colOffset(x)); }
+		void fetchQuad(const std::uint16_t &x0, const std::uint16_t &y0, const std::uint16_t &x1, 
+			const std::uint16_t &y1, glm::vec4 *texels) const
+		{
+			gatherQuad(colOffset(x0), colOffset(x1), rowOffset(y0), rowOffset(y1), texels);
+		}
+
 	private:
+		//Linear address mapping: y * width + x
+		unsigned int rowOffset(const std::uint16_t &y) const { return y * m_width; }
+		unsigned int colOffset(const std::uint16_t &x) const { return x; }
+
 		virtual unsigned int xyToIndex(const std::uint16_t &x, const std::uint16_t &y) const override;
 
 	};
@@ -51,9 +241,21 @@ namespace TinyRenderer
 	public:
 		typedef std::shared_ptr<TRTilingTextureHolder> ptr;
 
-		TRTilingTextureHolder(unsigned char *data, std::uint16_t width, std::uint16_t height, int channel);
+		//Note: the texels are converted from data to the given format
+		template<typename T>
+		TRTilingTextureHolder(const T *data, std::uint16_t width, std::uint16_t height, int channel, 
+			TRTextureFormat format = TRTextureFormat::TR_TEXTURE_FORMAT_RGBA8);
 		virtual ~TRTilingTextureHolder() = default;
 
+		//Non-virtual texel fetching
+		//Note: please guarantee that x and y are in [0,width-1],[0,height-1] respectively
+		glm::vec4 fetch(const std::uint16_t &x, const std::uint16_t &y) const { return fetchTexel(rowOffset(y) + colOffset(x)); }
+		void fetchQuad(const std::uint16_t &x0, const std::uint16_t &y0, const std::uint16_t &x1,
+			const std::uint16_t &y1, glm::vec4 *texels) const
+		{
+			gatherQuad(colOffset(x0), colOffset(x1), rowOffset(y0), rowOffset(y1), texels);
+		}
+
 	private:
 		//Change the k_blockSize, you should also change the corresponding code in xyToIndex
 		static constexpr int k_blockSize = 4;
@@ -62,6 +264,10 @@ namespace TinyRenderer
 		int m_widthInTiles = 0;
 		int m_heightInTiles = 0;
 
+		//Tiling address mapping is separable: index = rowOffset(y) + colOffset(x)
+		unsigned int rowOffset(const std::uint16_t &y) const { return (((y >> 2) * m_widthInTiles) << 4) + ((y & 3) << 2); }
+		unsigned int colOffset(const std::uint16_t &x) const { return ((x >> 2) << 4) + (x & 3); }
+
 		virtual unsigned int xyToIndex(const std::uint16_t &x, const std::uint16_t & y) const override;
 
 	};
@@ -73,9 +279,21 @@ namespace TinyRenderer
 	public:
 		typedef std::shared_ptr<TRZCurveTilingTextureHolder> ptr;
 
-		TRZCurveTilingTextureHolder(unsigned char *data, std::uint16_t width, std::uint16_t height, int channel);
+		//Note: the texels are converted from data to the given format
+		template<typename T>
+		TRZCurveTilingTextureHolder(const T *data, std::uint16_t width, std::uint16_t height, int channel, 
+			TRTextureFormat format = TRTextureFormat::TR_TEXTURE_FORMAT_RGBA8);
 		virtual ~TRZCurveTilingTextureHolder() = default;
 
+		//Non-virtual texel fetching
+		//Note: please guarantee that x and y are in [0,width-1],[0,height-1] respectively
+		glm::vec4 fetch(const std::uint16_t &x, const std::uint16_t &y) const { return fetchTexel(rowOffset(y) + colOffset(x)); }
+		void fetchQuad(const std::uint16_t &x0, const std::uint16_t &y0, const std::uint16_t &x1,
+			const std::uint16_t &y1, glm::vec4 *texels) const
+		{
+			gatherQuad(colOffset(x0), colOffset(x1), rowOffset(y0), rowOffset(y1), texels);
+		}
+
 	private:
 		//Block size for tiling
 		static constexpr int k_blockSize = 32; //Note: block size should not exceed 256
@@ -85,37 +303,184 @@ namespace TinyRenderer
 		int m_widthInTiles = 0;
 		int m_heightInTiles = 0;
 
+		//Morton code is the interleaving of x bits (even) and y bits (odd), so that the address 
+		//mapping is separable as well: index = rowOffset(y) + colOffset(x)
+		unsigned int rowOffset(const std::uint16_t &y) const 
+		{ 
+			return (y >> bits) * m_widthInTiles * k_blockSize2 + (spreadBits(y & (k_blockSize - 1)) << 1); 
+		}
+		unsigned int colOffset(const std::uint16_t &x) const 
+		{ 
+			return (x >> bits) * k_blockSize2 + spreadBits(x & (k_blockSize - 1)); 
+		}
+
 		virtual unsigned int xyToIndex(const std::uint16_t &x, const std::uint16_t & y) const override;
 
-		static void decodeMortonCurve(const std::uint16_t &index, std::uint8_t &x, std::uint8_t &y)
+		//Insert a zero bit between each of the lower 8 bits
+		inline static unsigned int spreadBits(unsigned int v)
+		{
+			v = (v | (v << 4)) & 0x0F0F;
+			v = (v | (v << 2)) & 0x3333;
+			v = (v | (v << 1)) & 0x5555;
+			return v;
+		}
+	};
+
+	//Codecs of 4x4 texels blocks (64 bits)
+	//Refs: https://docs.microsoft.com/en-us/windows/win32/direct3d10/d3d10-graphics-programming-guide-resources-block-compression
+	class TRBlockCodec final
+	{
+	public:
+		//BC1 color block: two RGB565 endpoints and 2-bit indices
+		//Note: rgba of 16 texels, the encoded block is always opaque
+		static std::uint64_t encodeBC1(const unsigned char *rgba);
+		//Decoding of texel i as 32bpp RGBA, threeColor -> the 3 colors + transparent black mode is allowed
+		static std::uint32_t decodeBC1(const std::uint64_t &block, const unsigned int &i, const bool &threeColor)
 		{
-			//Morton curve decoding
-			//Refs: https://en.wikipedia.org/wiki/Z-order_curve
-			x = 0, y = 0;
-			for (int i = 0; i < bits; ++i)
+			const unsigned int c0 = block & 0xFFFF, c1 = (block >> 16) & 0xFFFF;
+			const unsigned int index = (block >> (32 + 2 * i)) & 3;
+			const unsigned int r0 = expand5((c0 >> 11) & 31), g0 = expand6((c0 >> 5) & 63), b0 = expand5(c0 & 31);
+			const unsigned int r1 = expand5((c1 >> 11) & 31), g1 = expand6((c1 >> 5) & 63), b1 = expand5(c1 & 31);
+			unsigned int r, g, b, a = 255;
+			if (c0 > c1 || !threeColor)
+			{
+				switch (index)
+				{
+				case 0: r = r0, g = g0, b = b0; break;
+				case 1: r = r1, g = g1, b = b1; break;
+				case 2: r = (2 * r0 + r1) / 3, g = (2 * g0 + g1) / 3, b = (2 * b0 + b1) / 3; break;
+				default: r = (r0 + 2 * r1) / 3, g = (g0 + 2 * g1) / 3, b = (b0 + 2 * b1) / 3; break;
+				}
+			}
+			else
 			{
-				x |= (index & (1 << (2 * i))) >> i;
-				y |= (index & (1 << (2 * i + 1))) >> (i + 1);
+				switch (index)
+				{
+				case 0: r = r0, g = g0, b = b0; break;
+				case 1: r = r1, g = g1, b = b1; break;
+				case 2: r = (r0 + r1) / 2, g = (g0 + g1) / 2, b = (b0 + b1) / 2; break;
+				default: r = g = b = a = 0; break;
+				}
 			}
+			return (r << 24) | (g << 16) | (b << 8) | (a << 0);
 		}
 
-		inline static void encodeMortonCurve(const std::uint8_t &x, const std::uint8_t &y, std::uint16_t &index)
+		//BC4 single channel block: two 8-bit endpoints and 3-bit indices
+		//Note: values of 16 texels
+		static std::uint64_t encodeBC4(const unsigned char *values);
+		static unsigned int decodeBC4(const std::uint64_t &block, const unsigned int &i)
 		{
-			//Morton curve encoding
-			//Refs: https://en.wikipedia.org/wiki/Z-order_curve
-			index = 0;
-			index |= ((x & (1 << 0)) << (0)) | ((y & (1 << 0)) << (1));
-			index |= ((x & (1 << 1)) << (1)) | ((y & (1 << 1)) << (2));
-			index |= ((x & (1 << 2)) << (2)) | ((y & (1 << 2)) << (3));
-			index |= ((x & (1 << 3)) << (3)) | ((y & (1 << 3)) << (4));
-			index |= ((x & (1 << 4)) << (4)) | ((y & (1 << 4)) << (5));
-			index |= ((x & (1 << 5)) << (5)) | ((y & (1 << 5)) << (6));
-			index |= ((x & (1 << 6)) << (6)) | ((y & (1 << 6)) << (7));
-			index |= ((x & (1 << 7)) << (7)) | ((y & (1 << 7)) << (8));
-			index |= ((x & (1 << 8)) << (8)) | ((y & (1 << 8)) << (9));
-			index |= ((x & (1 << 9)) << (9)) | ((y & (1 << 9)) << (10));
+			const unsigned int v0 = block & 0xFF, v1 = (block >> 8) & 0xFF;
+			const unsigned int index = (block >> (16 + 3 * i)) & 7;
+			if (index <= 1)
+				return index == 0 ? v0 : v1;
+			if (v0 > v1)
+				return ((8 - index) * v0 + (index - 1) * v1) / 7;
+			//6 values + 0 and 255 mode
+			if (index >= 6)
+				return index == 6 ? 0 : 255;
+			return ((6 - index) * v0 + (index - 1) * v1) / 5;
 		}
+
+	private:
+		static unsigned int expand5(const unsigned int &v) { return (v << 3) | (v >> 2); }
+		static unsigned int expand6(const unsigned int &v) { return (v << 2) | (v >> 4); }
 	};
+
+	//Block compressed layouts: 4x4 texels blocks in row-major order, which are decoded on fetching.
+	//Note: BC1 and BC4 take 64 bits per block, BC3 (BC4 alpha + BC1 color) and BC5 (BC4 red + BC4 green) take 128 bits,
+	//      i.e. 8x and 4x smaller than 32bpp respectively.
+	template<TRTextureLayout Layout>
+	class TRBlockCompressedTextureHolder final : public TRTextureHolder
+	{
+	public:
+		typedef std::shared_ptr<TRBlockCompressedTextureHolder> ptr;
+
+		static_assert(Layout == TR_TEXTURE_LAYOUT_BC1 || Layout == TR_TEXTURE_LAYOUT_BC3 ||
+			Layout == TR_TEXTURE_LAYOUT_BC4 || Layout == TR_TEXTURE_LAYOUT_BC5, "Layout should be a block compressed one");
+
+		//Note: the blocks are encoded from data at loading time, float data is clamped to [0,1]
+		template<typename T>
+		TRBlockCompressedTextureHolder(const T *data, std::uint16_t width, std::uint16_t height, int channel);
+		virtual ~TRBlockCompressedTextureHolder() = default;
+
+		virtual glm::vec4 read(const std::uint16_t &x, const std::uint16_t &y) const override { return fetch(x, y); }
+
+		//Non-virtual texel fetching
+		//Note: please guarantee that x and y are in [0,width-1],[0,height-1] respectively
+		glm::vec4 fetch(const std::uint16_t &x, const std::uint16_t &y) const 
+		{ 
+			return unpackRGBA8(decodeBlockTexel(&m_blocks[rowOffset(y) + colOffset(x)], ((y & 3) << 2) | (x & 3)));
+		}
+		void fetchQuad(const std::uint16_t &x0, const std::uint16_t &y0, const std::uint16_t &x1,
+			const std::uint16_t &y1, glm::vec4 *texels) const
+		{
+			const unsigned int row0 = rowOffset(y0), row1 = rowOffset(y1);
+			const unsigned int col0 = colOffset(x0), col1 = colOffset(x1);
+			texels[0] = unpackRGBA8(decodeBlockTexel(&m_blocks[row0 + col0], ((y0 & 3) << 2) | (x0 & 3)));
+			texels[1] = unpackRGBA8(decodeBlockTexel(&m_blocks[row0 + col1], ((y0 & 3) << 2) | (x1 & 3)));
+			texels[2] = unpackRGBA8(decodeBlockTexel(&m_blocks[row1 + col0], ((y1 & 3) << 2) | (x0 & 3)));
+			texels[3] = unpackRGBA8(decodeBlockTexel(&m_blocks[row1 + col1], ((y1 & 3) << 2) | (x1 & 3)));
+		}
+
+	private:
+		//64-bit words per block
+		static constexpr int k_blockWords = (Layout == TR_TEXTURE_LAYOUT_BC3 || Layout == TR_TEXTURE_LAYOUT_BC5) ? 2 : 1;
+
+		int m_widthInBlocks = 0;
+		int m_heightInBlocks = 0;
+		std::vector<std::uint64_t> m_blocks;
+
+		//Address of the block of (x,y): rowOffset(y) + colOffset(x)
+		unsigned int rowOffset(const std::uint16_t &y) const { return (y >> 2) * m_widthInBlocks * k_blockWords; }
+		unsigned int colOffset(const std::uint16_t &x) const { return (x >> 2) * k_blockWords; }
+
+		virtual unsigned int xyToIndex(const std::uint16_t &x, const std::uint16_t & y) const override;
+
+		//Decoding of texel i of the block as 32bpp RGBA
+		static std::uint32_t decodeBlockTexel(const std::uint64_t *block, const unsigned int &i);
+	};
+
+	template<>
+	inline std::uint32_t TRBlockCompressedTextureHolder<TR_TEXTURE_LAYOUT_BC1>::decodeBlockTexel(const std::uint64_t *block, 
+		const unsigned int &i)
+	{
+		return TRBlockCodec::decodeBC1(block[0], i, true);
+	}
+
+	template<>
+	inline std::uint32_t TRBlockCompressedTextureHolder<TR_TEXTURE_LAYOUT_BC3>::decodeBlockTexel(const std::uint64_t *block, 
+		const unsigned int &i)
+	{
+		//Note: the color block of BC3 is always in 4 colors mode
+		return (TRBlockCodec::decodeBC1(block[1], i, false) & 0xFFFFFF00) | TRBlockCodec::decodeBC4(block[0], i);
+	}
+
+	template<>
+	inline std::uint32_t TRBlockCompressedTextureHolder<TR_TEXTURE_LAYOUT_BC4>::decodeBlockTexel(const std::uint64_t *block, 
+		const unsigned int &i)
+	{
+		//Gray
+		const unsigned int v = TRBlockCodec::decodeBC4(block[0], i);
+		return (v << 24) | (v << 16) | (v << 8) | 0xFF;
+	}
+
+	template<>
+	inline std::uint32_t TRBlockCompressedTextureHolder<TR_TEXTURE_LAYOUT_BC5>::decodeBlockTexel(const std::uint64_t *block, 
+		const unsigned int &i)
+	{
+		//Unit normal: z = sqrt(1 - x^2 - y^2), mapped from [-1,1] to [0,255]
+		const unsigned int r = TRBlockCodec::decodeBC4(block[0], i), g = TRBlockCodec::decodeBC4(block[1], i);
+		const float x = r * (2.0f / 255.0f) - 1.0f, y = g * (2.0f / 255.0f) - 1.0f;
+		const float z = std::sqrt(std::max(1.0f - x * x - y * y, 0.0f));
+		const unsigned int b = (unsigned int)((z * 0.5f + 0.5f) * 255.0f + 0.5f);
+		return (r << 24) | (g << 16) | (b << 8) | 0xFF;
+	}
+
+	using TRBC1TextureHolder = TRBlockCompressedTextureHolder<TR_TEXTURE_LAYOUT_BC1>;
+	using TRBC3TextureHolder = TRBlockCompressedTextureHolder<TR_TEXTURE_LAYOUT_BC3>;
+	using TRBC4TextureHolder = TRBlockCompressedTextureHolder<TR_TEXTURE_LAYOUT_BC4>;
+	using TRBC5TextureHolder = TRBlockCompressedTextureHolder<TR_TEXTURE_LAYOUT_BC5>;
 }
 
 #endif
\ No newline at end of file
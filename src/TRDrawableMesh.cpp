@@ -39,6 +39,7 @@ namespace TinyRenderer
 		std::map<std::string, int> textureDict = {};
 		std::string directory = "";
 		bool generatedMipmap = false;
+		bool compressedTexture = false;
 
 		TRDrawableSubMesh processMesh(aiMesh *mesh, const aiScene *scene)
 		{
@@ -90,7 +91,7 @@ namespace TinyRenderer
 			// process materials
 			aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 
-			auto loadFunc = [&](aiTextureType type) -> int
+			auto loadFunc = [&](aiTextureType type, TRTextureCompressionMode compression) -> int
 			{
 				for (int i = 0; i < material->GetTextureCount(type); ++i)
 				{
@@ -104,7 +105,8 @@ namespace TinyRenderer
 					else
 					{
 						TRTexture2D::ptr diffTex = std::make_shared<TRTexture2D>(generatedMipmap);
-						bool success = diffTex->loadTextureFromFile(directory + '/' + str.C_Str());
+						bool success = diffTex->loadTextureFromFile(directory + '/' + str.C_Str(), TRTextureWarpMode::TR_REPEAT,
+							TRTextureFilterMode::TR_LINEAR, compressedTexture ? compression : TRTextureCompressionMode::TR_TEXTURE_COMPRESSION_DISABLE);
 						auto texId = TRShadingPipeline::uploadTexture2D(diffTex);
 						textureDict.insert({ str.C_Str(), texId });
 						return texId;
@@ -114,10 +116,11 @@ namespace TinyRenderer
 			};
 
 			//Texture maps
-			drawable.setDiffuseMapTexId(loadFunc(aiTextureType_DIFFUSE));
-			drawable.setSpecularMapTexId(loadFunc(aiTextureType_SPECULAR));
-			drawable.setNormalMapTexId(loadFunc(aiTextureType_HEIGHT));
-			drawable.setGlowMapTexId(loadFunc(aiTextureType_EMISSIVE));
+			//Note: the block compression format depends on the usage of the map
+			drawable.setDiffuseMapTexId(loadFunc(aiTextureType_DIFFUSE, TRTextureCompressionMode::TR_TEXTURE_COMPRESSION_COLOR));
+			drawable.setSpecularMapTexId(loadFunc(aiTextureType_SPECULAR, TRTextureCompressionMode::TR_TEXTURE_COMPRESSION_GRAY));
+			drawable.setNormalMapTexId(loadFunc(aiTextureType_HEIGHT, TRTextureCompressionMode::TR_TEXTURE_COMPRESSION_NORMAL));
+			drawable.setGlowMapTexId(loadFunc(aiTextureType_EMISSIVE, TRTextureCompressionMode::TR_TEXTURE_COMPRESSION_COLOR));
 
 			drawable.setVertices(vertices);
 			drawable.setIndices(indices);
@@ -145,7 +148,7 @@ namespace TinyRenderer
 
 	//----------------------------------------------TRDrawableMesh----------------------------------------------
 
-	void TRDrawableMesh::importMeshFromFile(const std::string &path, bool generatedMipmap)
+	void TRDrawableMesh::importMeshFromFile(const std::string &path, bool generatedMipmap, bool compressedTexture)
 	{
 		for (auto &drawable : m_drawables)
 		{
@@ -167,6 +170,7 @@ namespace TinyRenderer
 		// retrieve the directory path of the filepath
 		AssimpImporterWrapper wrapper;
 		wrapper.generatedMipmap = generatedMipmap;
+		wrapper.compressedTexture = compressedTexture;
 		wrapper.directory = path.substr(0, path.find_last_of('/'));
 		wrapper.processNode(scene->mRootNode, scene, m_drawables);
 		
@@ -180,9 +184,25 @@ namespace TinyRenderer
 		}
 	}
 
-	TRDrawableMesh::TRDrawableMesh(const std::string &path, bool generatedMipmap)
+	TRDrawableMesh::TRDrawableMesh(const std::string &path, bool generatedMipmap, bool compressedTexture)
 	{
-		importMeshFromFile(path, generatedMipmap);
+		importMeshFromFile(path, generatedMipmap, compressedTexture);
+	}
+
+	void TRDrawableMesh::setMaxAnisotropy(const int &maxAnisotropy)
+	{
+		for (const auto &drawable : m_drawables)
+		{
+			for (const int &texId : { drawable.getDiffuseMapTexId(), drawable.getSpecularMapTexId(),
+				drawable.getNormalMapTexId(), drawable.getGlowMapTexId() })
+			{
+				auto texture = TRShadingPipeline::getTexture2D(texId);
+				if (texture != nullptr)
+				{
+					texture->setMaxAnisotropy(maxAnisotropy);
+				}
+			}
+		}
 	}
 
 	unsigned int TRDrawableMesh::getDrawableMaxFaceNums() const
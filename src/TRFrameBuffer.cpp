@@ -1,41 +1,248 @@
 #include "TRFrameBuffer.h"
 
 #include <cmath>
+#include <thread>
 #include <algorithm>
 
 #include "TRParallelWrapper.h"
 
 namespace TinyRenderer
 {
-	TRFrameBuffer::TRFrameBuffer(int width, int height)
-		: m_width(width), m_height(height)
+	constexpr int TRFrameBuffer::k_microTileSize;
+	constexpr int TRFrameBuffer::k_macroTileSize;
+	constexpr int TRFrameBuffer::k_hizTileSize;
+	constexpr std::uint32_t TRFrameBuffer::k_maxD16;
+	constexpr std::uint32_t TRFrameBuffer::k_maxD24;
+
+	TRFrameBuffer::TRFrameBuffer(int width, int height, int samplingNum, TRDepthFormat depthFormat, 
+		TRReverseZMode reverseZ)
+		: m_depthFormat(depthFormat), m_reverseZ(reverseZ),
+		m_depthExact(depthFormat == TRDepthFormat::TR_DEPTH_FORMAT_D32F && reverseZ == TRReverseZMode::TR_REVERSE_Z_ENABLE),
+		m_width(width), m_height(height), 
+		m_widthInMacroTiles((width + k_macroTileSize - 1) / k_macroTileSize),
+		m_heightInMacroTiles((height + k_macroTileSize - 1) / k_macroTileSize),
+		m_samplingNum(samplingNum), m_fullMask((1u << samplingNum) - 1),
+		m_hizWidth((width + k_hizTileSize - 1) / k_hizTileSize),
+		m_hizHeight((height + k_hizTileSize - 1) / k_hizTileSize),
+		m_hizDepth(m_hizWidth * m_hizHeight), m_hizDirty(m_hizWidth * m_hizHeight),
+		m_depthTileState(m_hizWidth * m_hizHeight), m_colorTileState(m_hizWidth * m_hizHeight)
+	{
+		//Note: the sampling points of a pixel are contiguous, and the tiled buffers are padded to the macro tiles
+		const uint numPixels = m_widthInMacroTiles * m_heightInMacroTiles * k_macroTileSize * k_macroTileSize;
+		m_planeSize = numPixels;
+		switch (m_depthFormat)
+		{
+		case TRDepthFormat::TR_DEPTH_FORMAT_D16: m_depthPlanesD16.resize(m_planeSize * m_samplingNum, 0); break;
+		case TRDepthFormat::TR_DEPTH_FORMAT_D24: m_depthPlanesD24.resize(m_planeSize * m_samplingNum, 0); break;
+		default: m_depthPlanesD32F.resize(m_planeSize * m_samplingNum, 0.0f); break;
+		}
+		m_colorBuffer.resize(numPixels * m_samplingNum, k_trBlack);
+		m_resolvedBuffer.resize(m_width * m_height, k_trBlack);
+		m_colorUniform.resize(numPixels, 1);
+		for (size_t t = 0; t < m_depthTileState.size(); ++t)
+		{
+			m_depthTileState[t].store(TR_TILE_READY, std::memory_order_relaxed);
+			m_colorTileState[t].store(TR_TILE_READY, std::memory_order_relaxed);
+		}
+		clearDepth(1.0f);
+	}
+
+	//----------------------------------------------DepthFormat----------------------------------------------
+
+	std::uint32_t TRFrameBuffer::encodeUnormDepth(const float &depth, const std::uint32_t &maxValue) const
+	{
+		//Note: double precision for the 24 bits
+		double normalized = glm::clamp(static_cast<double>(depth) * m_depthNear, 0.0, 1.0);
+		if (m_reverseZ == TRReverseZMode::TR_REVERSE_Z_DISABLE)
+			normalized = 1.0 - normalized;
+		return static_cast<std::uint32_t>(normalized * maxValue + 0.5);
+	}
+
+	float TRFrameBuffer::decodeUnormDepth(const std::uint32_t &value, const std::uint32_t &maxValue) const
+	{
+		double normalized = static_cast<double>(value) / maxValue;
+		if (m_reverseZ == TRReverseZMode::TR_REVERSE_Z_DISABLE)
+			normalized = 1.0 - normalized;
+		return static_cast<float>(normalized / m_depthNear);
+	}
+
+	float TRFrameBuffer::encodeFloatDepth(const float &depth) const
+	{
+		return (m_reverseZ == TRReverseZMode::TR_REVERSE_Z_ENABLE) ? depth : 1.0f - depth * m_depthNear;
+	}
+
+	float TRFrameBuffer::decodeFloatDepth(const float &value) const
 	{
-		m_depthBuffer.resize(m_width * m_height, 1.0f);
-		m_colorBuffer.resize(m_width * m_height, k_trBlack);
+		return (m_reverseZ == TRReverseZMode::TR_REVERSE_Z_ENABLE) ? value : (1.0f - value) / m_depthNear;
+	}
+
+	float TRFrameBuffer::roundDepth(const float &depth) const
+	{
+		switch (m_depthFormat)
+		{
+		case TRDepthFormat::TR_DEPTH_FORMAT_D16: return decodeUnormDepth(encodeUnormDepth(depth, k_maxD16), k_maxD16);
+		case TRDepthFormat::TR_DEPTH_FORMAT_D24: return decodeUnormDepth(encodeUnormDepth(depth, k_maxD24), k_maxD24);
+		default: return decodeFloatDepth(encodeFloatDepth(depth));
+		}
+	}
+
+	void TRFrameBuffer::setDepthNear(const float &near)
+	{
+		m_depthNear = near;
+		updateClearDepth();
+	}
+
+	void TRFrameBuffer::updateClearDepth()
+	{
+		//Note: the stored clear depth is kept, so that the tiles filled read as the cleared ones
+		switch (m_depthFormat)
+		{
+		case TRDepthFormat::TR_DEPTH_FORMAT_D16:
+			m_clearDepthUnorm = encodeUnormDepth(m_clearDepthValue, k_maxD16);
+			m_clearDepth = decodeUnormDepth(m_clearDepthUnorm, k_maxD16);
+			break;
+		case TRDepthFormat::TR_DEPTH_FORMAT_D24:
+			m_clearDepthUnorm = encodeUnormDepth(m_clearDepthValue, k_maxD24);
+			m_clearDepth = decodeUnormDepth(m_clearDepthUnorm, k_maxD24);
+			break;
+		default:
+			m_clearDepthFloat = encodeFloatDepth(m_clearDepthValue);
+			m_clearDepth = decodeFloatDepth(m_clearDepthFloat);
+			break;
+		}
+	}
+
+	float TRFrameBuffer::loadDepth(const size_t &index) const
+	{
+		switch (m_depthFormat)
+		{
+		case TRDepthFormat::TR_DEPTH_FORMAT_D16: return decodeUnormDepth(m_depthPlanesD16[index], k_maxD16);
+		case TRDepthFormat::TR_DEPTH_FORMAT_D24: return decodeUnormDepth(m_depthPlanesD24[index], k_maxD24);
+		default: return m_depthExact ? m_depthPlanesD32F[index] : decodeFloatDepth(m_depthPlanesD32F[index]);
+		}
 	}
 
+	float TRFrameBuffer::storeDepth(const size_t &index, const float &depth)
+	{
+		switch (m_depthFormat)
+		{
+		case TRDepthFormat::TR_DEPTH_FORMAT_D16:
+		{
+			const std::uint32_t value = encodeUnormDepth(depth, k_maxD16);
+			m_depthPlanesD16[index] = static_cast<std::uint16_t>(value);
+			return decodeUnormDepth(value, k_maxD16);
+		}
+		case TRDepthFormat::TR_DEPTH_FORMAT_D24:
+		{
+			const std::uint32_t value = encodeUnormDepth(depth, k_maxD24);
+			m_depthPlanesD24[index] = value;
+			return decodeUnormDepth(value, k_maxD24);
+		}
+		default:
+		{
+			if (m_depthExact)
+			{
+				m_depthPlanesD32F[index] = depth;
+				return depth;
+			}
+			const float value = encodeFloatDepth(depth);
+			m_depthPlanesD32F[index] = value;
+			return decodeFloatDepth(value);
+		}
+		}
+	}
+
+	void TRFrameBuffer::fillClearDepth(const size_t &index, const size_t &count)
+	{
+		switch (m_depthFormat)
+		{
+		case TRDepthFormat::TR_DEPTH_FORMAT_D16:
+			std::fill_n(&m_depthPlanesD16[index], count, static_cast<std::uint16_t>(m_clearDepthUnorm));
+			break;
+		case TRDepthFormat::TR_DEPTH_FORMAT_D24:
+			std::fill_n(&m_depthPlanesD24[index], count, m_clearDepthUnorm);
+			break;
+		default:
+			std::fill_n(&m_depthPlanesD32F[index], count, m_clearDepthFloat);
+			break;
+		}
+	}
+
+	//Extremes of the stored values
+	template<typename T>
+	static inline void loadMinMax(const T *values, const size_t &count, T &minValue, T &maxValue)
+	{
+		minValue = maxValue = values[0];
+		for (size_t i = 1; i < count; ++i)
+		{
+			minValue = glm::min(minValue, values[i]);
+			maxValue = glm::max(maxValue, values[i]);
+		}
+	}
+
+	float TRFrameBuffer::loadMinDepth(const size_t &index, const size_t &count) const
+	{
+		//Note: the decoding is monotonic, increasing for reverse-Z and decreasing otherwise,
+		//      hence only one of the extremes is decoded
+		const bool reverse = m_reverseZ == TRReverseZMode::TR_REVERSE_Z_ENABLE;
+		switch (m_depthFormat)
+		{
+		case TRDepthFormat::TR_DEPTH_FORMAT_D16:
+		{
+			std::uint16_t minValue, maxValue;
+			loadMinMax(&m_depthPlanesD16[index], count, minValue, maxValue);
+			return decodeUnormDepth(reverse ? minValue : maxValue, k_maxD16);
+		}
+		case TRDepthFormat::TR_DEPTH_FORMAT_D24:
+		{
+			std::uint32_t minValue, maxValue;
+			loadMinMax(&m_depthPlanesD24[index], count, minValue, maxValue);
+			return decodeUnormDepth(reverse ? minValue : maxValue, k_maxD24);
+		}
+		default:
+		{
+			float minValue, maxValue;
+			loadMinMax(&m_depthPlanesD32F[index], count, minValue, maxValue);
+			return decodeFloatDepth(reverse ? minValue : maxValue);
+		}
+		}
+	}
+
+	//----------------------------------------------FrameBuffer----------------------------------------------
+
 	float TRFrameBuffer::readDepth(const uint &x, const uint &y, const unsigned int &i) const
 	{
 		if (x >= m_width || y >= m_height)
 			return 0.0f;
+		//Note: the fragments are the only writers of their own pixels, 
+		//      hence a pixel of the tile being filled is still the clear value
+		if (isTileCleared(m_depthTileState, x, y))
+			return m_clearDepth;
 		//Note: i is the sampling point index
-		return m_depthBuffer[y * m_width + x][i];
+		return loadDepth(i * m_planeSize + xyToIndex(x, y));
 	}
 
 	TRPixelRGBA TRFrameBuffer::readColor(const uint &x, const uint &y, const uint &i) const
 	{
 		if (x >= m_width || y >= m_height)
 			return k_trBlack;
+		if (isTileCleared(m_colorTileState, x, y))
+			return m_clearColor;
 		//Note: i is the sampling point index
-		return m_colorBuffer[y * m_width + x][i];
+		const uint pixel = xyToIndex(x, y);
+		return m_colorBuffer[pixel * m_samplingNum + (m_colorUniform[pixel] ? 0 : i)];
 	}
 
 	void TRFrameBuffer::clearDepth(const float &depth)
 	{
-		parallelFor((size_t)0, (size_t)(m_width * m_height), [&](const size_t &index)
+		//Note: O(tiles), the samples are filled lazily
+		m_clearDepthValue = depth;
+		updateClearDepth();
+		for (size_t t = 0; t < m_depthTileState.size(); ++t)
 		{
-			m_depthBuffer[index] = depth;
-		});
+			m_depthTileState[t].store(TR_TILE_CLEARED, std::memory_order_relaxed);
+		}
+		clearHiZ(m_clearDepth);
 	}
 
 	void TRFrameBuffer::clearColor(const glm::vec4 &color)
@@ -44,35 +251,89 @@ namespace TinyRenderer
 		unsigned char green = static_cast<unsigned char>(255 * color.y);
 		unsigned char blue = static_cast<unsigned char>(255 * color.z);
 		unsigned char alpha = static_cast<unsigned char>(255 * color.w);
-		TRPixelRGBA clearColor = { red, green, blue, alpha };
+		m_clearColor = { red, green, blue, alpha };
 
-		parallelFor((size_t)0, (size_t)(m_width * m_height), [&](const size_t &index)
+		//Note: O(tiles), the cleared pixels are filled lazily as uniform ones
+		for (size_t t = 0; t < m_colorTileState.size(); ++t)
 		{
-			m_colorBuffer[index] = clearColor;
-		});
+			m_colorTileState[t].store(TR_TILE_CLEARED, std::memory_order_relaxed);
+		}
 	}
 
 	void TRFrameBuffer::clearColorAndDepth(const glm::vec4 &color, const float &depth)
 	{
-		unsigned char red = static_cast<unsigned char>(255 * color.x);
-		unsigned char green = static_cast<unsigned char>(255 * color.y);
-		unsigned char blue = static_cast<unsigned char>(255 * color.z);
-		unsigned char alpha = static_cast<unsigned char>(255 * color.w);
-		TRPixelRGBA clearColor = { red, green, blue, alpha };
+		clearColor(color);
+		clearDepth(depth);
+	}
 
-		parallelFor((size_t)0, (size_t)(m_width * m_height), [&](const size_t &index)
+	bool TRFrameBuffer::beginTileFilling(std::atomic<unsigned char> &state)
+	{
+		unsigned char current = state.load(std::memory_order_acquire);
+		while (current != TR_TILE_READY)
+		{
+			if (current == TR_TILE_CLEARED)
+			{
+				//The first writer takes the filling
+				if (state.compare_exchange_weak(current, TR_TILE_FILLING, std::memory_order_acquire))
+					return true;
+			}
+			else
+			{
+				//Wait for the filling by another writer
+				std::this_thread::yield();
+				current = state.load(std::memory_order_acquire);
+			}
+		}
+		return false;
+	}
+
+	void TRFrameBuffer::acquireDepthTile(const uint &x, const uint &y)
+	{
+		auto &state = m_depthTileState[(y / k_hizTileSize) * m_hizWidth + (x / k_hizTileSize)];
+		if (state.load(std::memory_order_acquire) == TR_TILE_READY || !beginTileFilling(state))
+			return;
+		const uint beginX = x - x % k_hizTileSize, beginY = y - y % k_hizTileSize;
+		const uint endX = glm::min(beginX + k_hizTileSize, m_width);
+		const uint endY = glm::min(beginY + k_hizTileSize, m_height);
+		for (uint s = 0; s < m_samplingNum; ++s)
+		{
+			for (uint py = beginY; py < endY; ++py)
+			{
+				//Note: a row of pixels in a tile is contiguous in each plane
+				fillClearDepth(s * m_planeSize + xyToIndex(beginX, py), endX - beginX);
+			}
+		}
+		state.store(TR_TILE_READY, std::memory_order_release);
+	}
+
+	void TRFrameBuffer::acquireColorTile(const uint &x, const uint &y)
+	{
+		auto &state = m_colorTileState[(y / k_hizTileSize) * m_hizWidth + (x / k_hizTileSize)];
+		if (state.load(std::memory_order_acquire) == TR_TILE_READY || !beginTileFilling(state))
+			return;
+		const uint beginX = x - x % k_hizTileSize, beginY = y - y % k_hizTileSize;
+		const uint endX = glm::min(beginX + k_hizTileSize, m_width);
+		const uint endY = glm::min(beginY + k_hizTileSize, m_height);
+		for (uint py = beginY; py < endY; ++py)
 		{
-			m_depthBuffer[index] = depth;
-			m_colorBuffer[index] = clearColor;
-		});
+			for (uint px = beginX; px < endX; ++px)
+			{
+				//Note: cleared pixels are uniform, only the sampling point 0 is written
+				const uint pixel = xyToIndex(px, py);
+				m_colorBuffer[pixel * m_samplingNum] = m_clearColor;
+				m_colorUniform[pixel] = 1;
+			}
+		}
+		state.store(TR_TILE_READY, std::memory_order_release);
 	}
 
 	void TRFrameBuffer::writeDepth(const uint &x, const uint &y, const uint &i, const float &value)
 	{
 		if (x >= m_width || y >= m_height)
 			return;
+		acquireDepthTile(x, y);
 		//Note: i is the sampling point index
-		m_depthBuffer[y * m_width + x][i] = value;
+		updateHiZ(x, y, storeDepth(i * m_planeSize + xyToIndex(x, y), value));
 	}
 
 	void TRFrameBuffer::writeColor(const uint &x, const uint &y, const uint &i, const glm::vec4 &color)
@@ -85,11 +346,19 @@ namespace TinyRenderer
 		value[1] = static_cast<unsigned char>(color.y * 255);//GREEN
 		value[2] = static_cast<unsigned char>(color.z * 255);//BLUE
 		value[3] = static_cast<unsigned char>(glm::min(255 * color.w, 255.0f));//ALPHA
-		int index = y * m_width + x;
-		m_colorBuffer[index][i] = value;
+		acquireColorTile(x, y);
+		const uint pixel = xyToIndex(x, y);
+		if (m_colorUniform[pixel])
+		{
+			//Note: writing the same color keeps the pixel uniform
+			if (value == m_colorBuffer[pixel * m_samplingNum])
+				return;
+			expandColor(pixel);
+		}
+		m_colorBuffer[pixel * m_samplingNum + i] = value;
 	}
 
-	void TRFrameBuffer::writeColorWithMask(const uint &x, const uint &y, const glm::vec4 &color, const TRMaskPixelSampler &mask)
+	void TRFrameBuffer::writeColorWithMask(const uint &x, const uint &y, const glm::vec4 &color, const unsigned int &mask)
 	{
 		if (x >= m_width || y >= m_height)
 			return;
@@ -99,19 +368,34 @@ namespace TinyRenderer
 		value[2] = static_cast<unsigned char>(color.z * 255);//BLUE
 		value[3] = static_cast<unsigned char>(255 * color.w);//ALPHA
 
-		int index = y * m_width + x;
-		//Only write color if the corresponding mask equals to 1
-#pragma unroll
-		for (int s = 0; s < mask.getSamplingNum(); ++s)
+		acquireColorTile(x, y);
+		const uint pixel = xyToIndex(x, y);
+		const uint index = pixel * m_samplingNum;
+		//Fully covered: the pixel becomes uniform
+		if ((mask & m_fullMask) == m_fullMask)
 		{
-			if (mask[s] == 1)
+			m_colorBuffer[index] = value;
+			m_colorUniform[pixel] = 1;
+			return;
+		}
+		if (m_colorUniform[pixel])
+		{
+			if (value == m_colorBuffer[index])
+				return;
+			expandColor(pixel);
+		}
+
+		//Only write color if the corresponding mask bit equals to 1
+		for (uint s = 0; s < m_samplingNum; ++s)
+		{
+			if (mask & (1u << s))
 			{
-				m_colorBuffer[index][s] = value;
+				m_colorBuffer[index + s] = value;
 			}
 		}
 	}
 
-	void TRFrameBuffer::writeColorWithMaskAlphaBlending(const uint &x, const uint &y, const glm::vec4 &color, const TRMaskPixelSampler &mask)
+	void TRFrameBuffer::writeColorWithMaskAlphaBlending(const uint &x, const uint &y, const glm::vec4 &color, const unsigned int &mask)
 	{
 		if (x >= m_width || y >= m_height)
 			return;
@@ -125,48 +409,132 @@ namespace TinyRenderer
 		const float srcAlpha = color.a;
 		const float desAlpha = 1.0f - srcAlpha;
 
-		int index = y * m_width + x;
-		//Only write color if the corresponding mask equals to 1
-#pragma unroll
-		for (int s = 0; s < mask.getSamplingNum(); ++s)
+		acquireColorTile(x, y);
+		const uint pixel = xyToIndex(x, y);
+		const uint index = pixel * m_samplingNum;
+		//Note: blending a uniform pixel with full coverage keeps it uniform, hence only one sampling point is blended
+		uint numSamples = m_samplingNum;
+		if (m_colorUniform[pixel])
 		{
-			if (mask[s] == 1)
+			if ((mask & m_fullMask) == m_fullMask)
+				numSamples = 1;
+			else
+				expandColor(pixel);
+		}
+
+		//Only write color if the corresponding mask bit equals to 1
+		for (uint s = 0; s < numSamples; ++s)
+		{
+			if (mask & (1u << s))
 			{
-				m_colorBuffer[index][s][0] = value[0] * srcAlpha + m_colorBuffer[index][s][0] * desAlpha;
-				m_colorBuffer[index][s][1] = value[1] * srcAlpha + m_colorBuffer[index][s][1] * desAlpha;
-				m_colorBuffer[index][s][2] = value[2] * srcAlpha + m_colorBuffer[index][s][2] * desAlpha;
-				m_colorBuffer[index][s][3] = value[3];
+				auto &dst = m_colorBuffer[index + s];
+				dst[0] = value[0] * srcAlpha + dst[0] * desAlpha;
+				dst[1] = value[1] * srcAlpha + dst[1] * desAlpha;
+				dst[2] = value[2] * srcAlpha + dst[2] * desAlpha;
+				dst[3] = value[3];
 			}
 		}
 	}
 
-	void TRFrameBuffer::writeDepthWithMask(const uint &x, const uint &y, const TRDepthPixelSampler &depth, const TRMaskPixelSampler &mask)
+	void TRFrameBuffer::writeDepthWithMask(const uint &x, const uint &y, const float *depth, const unsigned int &mask)
 	{
 		if (x >= m_width || y >= m_height)
 			return;
-		int index = y * m_width + x;
-		//Only write depth if the corresponding mask equals to 1
-#pragma unroll
-		for (int s = 0; s < mask.getSamplingNum(); ++s)
+		acquireDepthTile(x, y);
+		const uint pixel = xyToIndex(x, y);
+		float minDepth = m_hizDepth[(y / k_hizTileSize) * m_hizWidth + (x / k_hizTileSize)].load(std::memory_order_relaxed);
+		//Only write depth if the corresponding mask bit equals to 1
+		//Note: the hierarchical depth bounds the rounded depth
+		for (uint s = 0; s < m_samplingNum; ++s)
 		{
-			if (mask[s] == 1)
+			if (mask & (1u << s))
 			{
-				m_depthBuffer[index][s] = depth[s];
+				minDepth = glm::min(minDepth, storeDepth(s * m_planeSize + pixel, depth[s]));
 			}
 		}
+		updateHiZ(x, y, minDepth);
+	}
+
+	void TRFrameBuffer::expandColor(const uint &pixel)
+	{
+		const uint index = pixel * m_samplingNum;
+		for (uint s = 1; s < m_samplingNum; ++s)
+		{
+			m_colorBuffer[index + s] = m_colorBuffer[index];
+		}
+		m_colorUniform[pixel] = 0;
+	}
+
+	void TRFrameBuffer::clearHiZ(const float &depth)
+	{
+		for (size_t t = 0; t < m_hizDepth.size(); ++t)
+		{
+			m_hizDepth[t].store(depth, std::memory_order_relaxed);
+			m_hizDirty[t].store(false, std::memory_order_relaxed);
+		}
+	}
+
+	void TRFrameBuffer::updateHiZ(const uint &x, const uint &y, const float &depth)
+	{
+		//Note: the bound is lowered immediately to stay conservative (e.g. depth test disabled),
+		//      and it would be raised by refreshHiZ() later
+		const int tile = (y / k_hizTileSize) * m_hizWidth + (x / k_hizTileSize);
+		float current = m_hizDepth[tile].load(std::memory_order_relaxed);
+		while (depth < current && !m_hizDepth[tile].compare_exchange_weak(current, depth, std::memory_order_relaxed));
+		if (!m_hizDirty[tile].load(std::memory_order_relaxed))
+		{
+			m_hizDirty[tile].store(true, std::memory_order_relaxed);
+		}
+	}
+
+	void TRFrameBuffer::refreshHiZ()
+	{
+		parallelFor((int)0, m_hizWidth * m_hizHeight, [&](const int &tile)
+		{
+			if (!m_hizDirty[tile].load(std::memory_order_relaxed))
+				return;
+			const uint beginX = (tile % m_hizWidth) * k_hizTileSize;
+			const uint beginY = (tile / m_hizWidth) * k_hizTileSize;
+			const uint endX = glm::min(beginX + k_hizTileSize, m_width);
+			const uint endY = glm::min(beginY + k_hizTileSize, m_height);
+			float minDepth = loadDepth(xyToIndex(beginX, beginY));
+			for (uint s = 0; s < m_samplingNum; ++s)
+			{
+				for (uint y = beginY; y < endY; ++y)
+				{
+					//Note: a row of pixels in a tile is contiguous in each plane
+					minDepth = glm::min(minDepth, loadMinDepth(s * m_planeSize + xyToIndex(beginX, y), endX - beginX));
+				}
+			}
+			m_hizDepth[tile].store(minDepth, std::memory_order_relaxed);
+			m_hizDirty[tile].store(false, std::memory_order_relaxed);
+		}, TRExecutionPolicy::TR_PARALLEL);
 	}
 
 	const TRColorBuffer &TRFrameBuffer::resolve()
 	{
 		//MSAA Resolve according to coverage mask
 		//Refs: http://www.zwqxin.com/archives/opengl/talk-about-alpha-to-coverage.html
+		//Note: the tiled layout is converted to the linear one herein
 		parallelFor((size_t)0, (size_t)(m_width * m_height), [&](const size_t &index)
 		{
-			auto &currentSamper = m_colorBuffer[index];
+			const uint x = index % m_width, y = index / m_width;
+			if (isTileCleared(m_colorTileState, x, y))
+			{
+				m_resolvedBuffer[index] = m_clearColor;
+				return;
+			}
+			const uint pixel = xyToIndex(x, y);
+			//Note: the average of a uniform pixel is its color
+			if (m_colorUniform[pixel])
+			{
+				m_resolvedBuffer[index] = m_colorBuffer[pixel * m_samplingNum];
+				return;
+			}
+			const TRPixelRGBA *currentSamper = &m_colorBuffer[pixel * m_samplingNum];
 			glm::vec4 sum(0.0f);
 			//Average the sampling color for each shaded pixel.
-#pragma unroll
-			for (int s = 0; s < currentSamper.getSamplingNum(); ++s)
+			for (uint s = 0; s < m_samplingNum; ++s)
 			{
 				{
 					sum.x += currentSamper[s][0];//RED
@@ -175,16 +543,16 @@ namespace TinyRenderer
 					sum.w += currentSamper[s][3];//ALPHA
 				}
 			}
-			sum /= currentSamper.getSamplingNum();
+			sum /= static_cast<float>(m_samplingNum);
 			TRPixelRGBA value;
 			value[0] = static_cast<unsigned char>((sum.x));
 			value[1] = static_cast<unsigned char>((sum.y));
 			value[2] = static_cast<unsigned char>((sum.z));
 			value[3] = static_cast<unsigned char>((sum.w));
-			currentSamper[0] = value;
+			m_resolvedBuffer[index] = value;
 			
 		}, TRExecutionPolicy::TR_PARALLEL);
-		return m_colorBuffer;
+		return m_resolvedBuffer;
 	}
 
 }
@@ -0,0 +1,252 @@
+#include "TRRasterizer.h"
+
+#include "TRSIMD.h"
+
+namespace TinyRenderer
+{
+	//----------------------------------------------TRQuadCoverageSetup----------------------------------------------
+
+	template<int Samples>
+	TRQuadCoverageSetup<Samples>::TRQuadCoverageSetup(const glm::ivec3 &I, const glm::ivec3 &J, const glm::ivec3 &bias,
+		const glm::vec3 &rhw, const float &oneDivDelta)
+	{
+		//Note: the sampling offsets are multiples of 1/16 pixel, which are exact in sub-pixel units
+		const auto &samplingOffsetArray = TRSamplingPattern<Samples>::getSamplingOffsets();
+		for (int s = 0; s < k_samplingNum; ++s)
+		{
+			m_sampleX[s] = static_cast<int>(glm::round(samplingOffsetArray[s].x * k_subPixelScale));
+			m_sampleY[s] = static_cast<int>(glm::round(samplingOffsetArray[s].y * k_subPixelScale));
+		}
+
+		m_wideEdges = false;
+		for (int e = 0; e < 3; ++e)
+		{
+			for (int f = 0; f < 4; ++f)
+			{
+				for (int s = 0; s < k_samplingNum; ++s)
+				{
+					const int lane = f * k_samplingNum + s;
+					const int64_t offset = static_cast<int64_t>((f & 1) * k_subPixelScale + m_sampleX[s]) * I[e]
+						+ static_cast<int64_t>((f >> 1) * k_subPixelScale + m_sampleY[s]) * J[e];
+					m_wideEdges = m_wideEdges || glm::abs(offset) >= k_maxLaneOffset;
+					m_laneOffset[e][lane] = static_cast<int>(offset);
+				}
+			}
+			m_bias[e] = bias[e];
+			m_rhw[e] = rhw[e];
+		}
+		m_I = I;
+		m_J = J;
+		m_oneDivDelta = oneDivDelta;
+		//Note: the depth is a linear combination of the edge functions
+		const glm::vec3 Ipx = glm::vec3(I) * static_cast<float>(k_subPixelScale);
+		const glm::vec3 Jpx = glm::vec3(J) * static_cast<float>(k_subPixelScale);
+		m_depthDx = (Ipx[1] * oneDivDelta) * rhw[0] + (Ipx[2] * oneDivDelta) * rhw[1] + (Ipx[0] * oneDivDelta) * rhw[2];
+		m_depthDy = (Jpx[1] * oneDivDelta) * rhw[0] + (Jpx[2] * oneDivDelta) * rhw[1] + (Jpx[0] * oneDivDelta) * rhw[2];
+		m_maxDepth = glm::max(rhw[0], glm::max(rhw[1], rhw[2]));
+	}
+
+	template<int Samples>
+	TRBlockCoverage classifyBlockCoverage(const TRQuadCoverageSetup<Samples> &setup, const glm::i64vec3 &Cx, 
+		const glm::ivec2 &size)
+	{
+		//The edge function is linear, hence its extremums over the block are at the corners.
+		//Note: sampling points are within half a pixel from the pixel center, and the integer evaluation is exact
+		const int64_t halfPixel = k_subPixelScale / 2;
+		bool inside = true;
+		for (int e = 0; e < 3; ++e)
+		{
+			const int64_t ix0 = -halfPixel * setup.m_I[e], ix1 = (size.x * k_subPixelScale - halfPixel) * setup.m_I[e];
+			const int64_t jy0 = -halfPixel * setup.m_J[e], jy1 = (size.y * k_subPixelScale - halfPixel) * setup.m_J[e];
+			const int64_t minE = Cx[e] + glm::min(ix0, ix1) + glm::min(jy0, jy1) + setup.m_bias[e];
+			const int64_t maxE = Cx[e] + glm::max(ix0, ix1) + glm::max(jy0, jy1) + setup.m_bias[e];
+			//Counter-clockwise winding order: covered <=> E + bias <= 0
+			if (minE > 0)
+				return TR_BLOCK_OUTSIDE;
+			if (maxE > 0)
+				inside = false;
+		}
+		return inside ? TR_BLOCK_INSIDE : TR_BLOCK_PARTIAL;
+	}
+
+	template<int Samples>
+	float evaluateBlockMaxDepth(const TRQuadCoverageSetup<Samples> &setup, const glm::i64vec3 &Cx, const glm::ivec2 &size)
+	{
+		const glm::vec3 E = glm::vec3(Cx);
+		const float depth = (E[1] * setup.m_oneDivDelta) * setup.m_rhw[0]
+			+ (E[2] * setup.m_oneDivDelta) * setup.m_rhw[1] + (E[0] * setup.m_oneDivDelta) * setup.m_rhw[2];
+		const float maxDepth = depth
+			+ glm::max(-0.5f * setup.m_depthDx, (size.x - 0.5f) * setup.m_depthDx)
+			+ glm::max(-0.5f * setup.m_depthDy, (size.y - 0.5f) * setup.m_depthDy);
+		//Note: the depth of the samples inside never exceeds the nearest vertex,
+		//      and a margin for the rounding errors of per-sample evaluation
+		return glm::min(maxDepth, setup.m_maxDepth) * (1.0f + 1e-5f) + 1e-7f;
+	}
+
+	//----------------------------------------------Scalar kernel----------------------------------------------
+
+	template<int Samples, bool TestEdges>
+	unsigned int evaluateQuadCoverageScalar(const TRQuadCoverageSetup<Samples> &setup, const glm::i64vec3 &Cx,
+		float *coverageDepth)
+	{
+		const int samplingNum = Samples;
+		const glm::vec3 baseE = glm::vec3(Cx);
+		unsigned int coverage = 0;
+		for (int lane = 0; lane < TRQuadCoverageSetup<Samples>::k_numLanes; ++lane)
+		{
+			const int f = lane / samplingNum, s = lane % samplingNum;
+			const int64_t dx = (f & 1) * k_subPixelScale + setup.m_sampleX[s];
+			const int64_t dy = (f >> 1) * k_subPixelScale + setup.m_sampleY[s];
+
+			//Edge function
+			bool inside = true;
+			float E[3];
+			for (int e = 0; e < 3; ++e)
+			{
+				const int64_t offset = dx * setup.m_I[e] + dy * setup.m_J[e];
+				inside = inside && (Cx[e] + offset + setup.m_bias[e]) <= 0;
+				//Note: the same rounding as the SIMD kernels
+				E[e] = baseE[e] + static_cast<float>(offset);
+			}
+			//Note: Counter-clockwise winding order
+			if (!TestEdges || inside)
+			{
+				coverage |= (1u << lane);
+			}
+			//Note: each sampling point should have its own depth
+			coverageDepth[lane] = (E[1] * setup.m_oneDivDelta) * setup.m_rhw[0]
+				+ (E[2] * setup.m_oneDivDelta) * setup.m_rhw[1] + (E[0] * setup.m_oneDivDelta) * setup.m_rhw[2];
+		}
+		return coverage;
+	}
+
+	//Note: the lanes of the SIMD kernels are 32-bit, where the edge function at f0 is clamped to +-2^30.
+	//      The lane offsets are within k_maxLaneOffset, so that the signs of the clamped ones are kept.
+	static inline int clampEdgeFunction(const int64_t &E)
+	{
+		const int64_t bound = static_cast<int64_t>(1) << 30;
+		return static_cast<int>(glm::clamp(E, -bound, bound));
+	}
+
+#ifdef TR_SIMD_X86
+	//----------------------------------------------SSE2 kernel----------------------------------------------
+
+	template<int Samples, bool TestEdges>
+	static unsigned int evaluateQuadCoverageSSE2(const TRQuadCoverageSetup<Samples> &setup, const glm::i64vec3 &Cx,
+		float *coverageDepth)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 oneDivDelta = _mm_set1_ps(setup.m_oneDivDelta);
+		const __m128i base[3] = { _mm_set1_epi32(clampEdgeFunction(Cx[0] + setup.m_bias[0])), 
+			_mm_set1_epi32(clampEdgeFunction(Cx[1] + setup.m_bias[1])), _mm_set1_epi32(clampEdgeFunction(Cx[2] + setup.m_bias[2])) };
+		const __m128 baseE[3] = { _mm_set1_ps(static_cast<float>(Cx[0])), 
+			_mm_set1_ps(static_cast<float>(Cx[1])), _mm_set1_ps(static_cast<float>(Cx[2])) };
+		const __m128 rhw[3] = { _mm_set1_ps(setup.m_rhw[0]), _mm_set1_ps(setup.m_rhw[1]), _mm_set1_ps(setup.m_rhw[2]) };
+
+		unsigned int coverage = 0;
+		for (int lane = 0; lane < TRQuadCoverageSetup<Samples>::k_numLanes; lane += 4)
+		{
+			__m128 E[3];
+			__m128i outside = zero;
+			for (int e = 0; e < 3; ++e)
+			{
+				const __m128i offset = _mm_load_si128((const __m128i*)&setup.m_laneOffset[e][lane]);
+				E[e] = _mm_add_ps(baseE[e], _mm_cvtepi32_ps(offset));
+				if (TestEdges)
+					outside = _mm_or_si128(outside, _mm_cmpgt_epi32(_mm_add_epi32(base[e], offset), zero));
+			}
+			coverage |= static_cast<unsigned int>(_mm_movemask_ps(_mm_castsi128_ps(outside)) ^ 0xf) << lane;
+
+			__m128 depth = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_mul_ps(E[1], oneDivDelta), rhw[0]),
+				_mm_mul_ps(_mm_mul_ps(E[2], oneDivDelta), rhw[1])),
+				_mm_mul_ps(_mm_mul_ps(E[0], oneDivDelta), rhw[2]));
+			_mm_storeu_ps(&coverageDepth[lane], depth);
+		}
+		return coverage;
+	}
+
+	//----------------------------------------------AVX2 kernel----------------------------------------------
+
+	template<int Samples, bool TestEdges>
+	TR_TARGET_AVX2
+	static unsigned int evaluateQuadCoverageAVX2(const TRQuadCoverageSetup<Samples> &setup, const glm::i64vec3 &Cx,
+		float *coverageDepth)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256 oneDivDelta = _mm256_set1_ps(setup.m_oneDivDelta);
+		const __m256i base[3] = { _mm256_set1_epi32(clampEdgeFunction(Cx[0] + setup.m_bias[0])),
+			_mm256_set1_epi32(clampEdgeFunction(Cx[1] + setup.m_bias[1])), _mm256_set1_epi32(clampEdgeFunction(Cx[2] + setup.m_bias[2])) };
+		const __m256 baseE[3] = { _mm256_set1_ps(static_cast<float>(Cx[0])),
+			_mm256_set1_ps(static_cast<float>(Cx[1])), _mm256_set1_ps(static_cast<float>(Cx[2])) };
+		const __m256 rhw[3] = { _mm256_set1_ps(setup.m_rhw[0]), _mm256_set1_ps(setup.m_rhw[1]), _mm256_set1_ps(setup.m_rhw[2]) };
+
+		unsigned int coverage = 0;
+		for (int lane = 0; lane < TRQuadCoverageSetup<Samples>::k_numLanes; lane += 8)
+		{
+			__m256 E[3];
+			__m256i outside = zero;
+			for (int e = 0; e < 3; ++e)
+			{
+				const __m256i offset = _mm256_load_si256((const __m256i*)&setup.m_laneOffset[e][lane]);
+				E[e] = _mm256_add_ps(baseE[e], _mm256_cvtepi32_ps(offset));
+				if (TestEdges)
+					outside = _mm256_or_si256(outside, _mm256_cmpgt_epi32(_mm256_add_epi32(base[e], offset), zero));
+			}
+			coverage |= static_cast<unsigned int>(_mm256_movemask_ps(_mm256_castsi256_ps(outside)) ^ 0xff) << lane;
+
+			__m256 depth = _mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(_mm256_mul_ps(E[1], oneDivDelta), rhw[0]),
+				_mm256_mul_ps(_mm256_mul_ps(E[2], oneDivDelta), rhw[1])),
+				_mm256_mul_ps(_mm256_mul_ps(E[0], oneDivDelta), rhw[2]));
+			_mm256_storeu_ps(&coverageDepth[lane], depth);
+		}
+		return coverage;
+	}
+#endif
+
+	template<int Samples>
+	TRQuadCoverageKernel<Samples> getQuadCoverageKernel(const bool &testEdges, const bool &wideEdges)
+	{
+		const int numLanes = TRQuadCoverageSetup<Samples>::k_numLanes;
+		if (wideEdges)
+		{
+			return testEdges ? &evaluateQuadCoverageScalar<Samples, true> : &evaluateQuadCoverageScalar<Samples, false>;
+		}
+
+		//Note: CPU features would not change at runtime, hence detected once
+		static const TRQuadCoverageKernel<Samples> kernels[2] = 
+		{
+#ifdef TR_SIMD_X86
+			(numLanes % 8 == 0 && isAVX2Supported()) ? &evaluateQuadCoverageAVX2<Samples, false> :
+			//Note: SSE2 is always available on x86-64
+			(numLanes % 4 == 0) ? &evaluateQuadCoverageSSE2<Samples, false> :
+#endif
+			&evaluateQuadCoverageScalar<Samples, false>,
+#ifdef TR_SIMD_X86
+			(numLanes % 8 == 0 && isAVX2Supported()) ? &evaluateQuadCoverageAVX2<Samples, true> :
+			(numLanes % 4 == 0) ? &evaluateQuadCoverageSSE2<Samples, true> :
+#endif
+			&evaluateQuadCoverageScalar<Samples, true>
+		};
+		return kernels[testEdges ? 1 : 0];
+	}
+
+	//Instantiation of the sampling numbers of MSAA
+#define TR_INSTANTIATE_SAMPLING_NUM(Samples) \
+	template class TRQuadCoverageSetup<Samples>; \
+	template TRBlockCoverage classifyBlockCoverage<Samples>(const TRQuadCoverageSetup<Samples> &, \
+		const glm::i64vec3 &, const glm::ivec2 &); \
+	template float evaluateBlockMaxDepth<Samples>(const TRQuadCoverageSetup<Samples> &, \
+		const glm::i64vec3 &, const glm::ivec2 &); \
+	template unsigned int evaluateQuadCoverageScalar<Samples, true>(const TRQuadCoverageSetup<Samples> &, \
+		const glm::i64vec3 &, float *); \
+	template unsigned int evaluateQuadCoverageScalar<Samples, false>(const TRQuadCoverageSetup<Samples> &, \
+		const glm::i64vec3 &, float *); \
+	template TRQuadCoverageKernel<Samples> getQuadCoverageKernel<Samples>(const bool &, const bool &);
+
+	TR_INSTANTIATE_SAMPLING_NUM(1)
+	TR_INSTANTIATE_SAMPLING_NUM(2)
+	TR_INSTANTIATE_SAMPLING_NUM(4)
+	TR_INSTANTIATE_SAMPLING_NUM(8)
+}
@@ -17,11 +17,13 @@
 
 namespace TinyRenderer
 {
-	using MutexType = tbb::spin_mutex;				//TBB thread mutex type
+	using MutexType = TRFrameBufferMutex::MutexType;	//TBB thread mutex type
 	static constexpr int PIPELINE_BATCH_SIZE = 512; //The number of faces processed for each batch
+	static constexpr int BINNING_BATCH_SIZE = 8192; //The number of faces binned for each batch of tile binning
+	static constexpr int VERTEX_BATCH_SIZE = 1024;  //The number of vertices shaded for each batch
 
 	//The cache for rasterized results. For example: the face i -> FragmentCache[i]
-	using FragmentCache = std::array<std::vector<TRShadingPipeline::QuadFragments>, PIPELINE_BATCH_SIZE>;
+	using FragmentCache = std::vector<TRShadingPipeline::QuadFragmentStream>;
 
 	//----------------------------------------------DrawcallSetting----------------------------------------------
 	//Draw call setting which would be utilized in shading parallel pipeline 
@@ -34,58 +36,296 @@ namespace TinyRenderer
 		TRShadingPipeline *m_shaderHandler;			//Shader handler
 		const TRShadingState &m_shadingState;			//Shading state
 		const glm::mat4 &m_viewportMatrix;			//Viewport transformation matrix
+		glm::vec2 m_guardBand;						//Ndc extent of the guard band
 		float m_near, m_far;							//Near plane and far plane of frustum
 		TRFrameBuffer *m_frameBuffer;					//Framebuffer 
+		unsigned int m_varyings;						//Interpolant layout of the varyings declared by the shader
+		const TRFrameBuffer *m_hizBuffer;				//Hierarchical depth for occlusion culling (nullptr -> disabled)
+		const TRShadingPipeline::VertexData *m_shadedVertices = nullptr;	//Post-transform vertex cache (nullptr -> disabled)
+		int m_subPixelBits = k_subPixelBits;			//Sub-pixel precision of the vertex snapping
 
 		explicit DrawcallSetting(const TRVertexBuffer &vbo, const TRIndexBuffer &ibo, TRShadingPipeline *handler,
-			const TRShadingState &state, const glm::mat4 &viewportMat, float np, float fp, TRFrameBuffer *fb)
+			const TRShadingState &state, const glm::mat4 &viewportMat, const glm::vec2 &guardBand, 
+			float np, float fp, TRFrameBuffer *fb)
 			: m_vertexBuffer(vbo), m_indexBuffer(ibo), m_shaderHandler(handler), m_shadingState(state),
-			m_viewportMatrix(viewportMat), m_near(np), m_far(fp), m_frameBuffer(fb) {}
+			m_viewportMatrix(viewportMat), m_guardBand(guardBand), m_near(np), m_far(fp), m_frameBuffer(fb), 
+			m_varyings(TRShadingPipeline::getVaryingsLayout(handler->getVaryingFlags())),
+			m_hizBuffer(state.m_trDepthTestMode == TRDepthTestMode::TR_DEPTH_TEST_ENABLE ? fb : nullptr) {}
 	};
 
-	//----------------------------------------------FramebufferMutex----------------------------------------------
-	//Each point (i,j) of framebuffer have its own mutex lock for avoiding accessing conflict among different threads
-	class FramebufferMutex final
+	//----------------------------------------------GeometryProcessing----------------------------------------------
+	//Face culling in screen space
+	static inline bool shouldCulled(const glm::ivec2 &v0, const glm::ivec2 &v1, const glm::ivec2 &v2, TRCullFaceMode mode)
 	{
-	public:
-		FramebufferMutex(int width, int height)
-			: m_width(width), m_height(height)
+		if (mode == TRCullFaceMode::TR_CULL_DISABLE)
+			return false;
+		//Back face culling in screen space
+		//Note: 64-bit for the fixed-point positions
+		const glm::i64vec2 e1 = glm::i64vec2(v1 - v0);
+		const glm::i64vec2 e2 = glm::i64vec2(v2 - v0);
+		int64_t orient = e1.x * e2.y - e1.y * e2.x;
+		return (mode == TRCullFaceMode::TR_CULL_BACK) ? orient > 0 : orient < 0;
+	}
+
+	//Fixed-point screen space position snapped to the grid of 2^-bits pixel
+	static inline glm::ivec2 snapToSubPixel(const glm::vec4 &screenPos, const int &bits)
+	{
+		const glm::vec2 snapped = glm::floor(glm::vec2(screenPos) * static_cast<float>(1 << bits) + 0.5f);
+		return glm::ivec2(snapped) * (1 << (k_subPixelBits - bits));
+	}
+
+	//Vertex fetching and vertex shader stage
+	template<unsigned int Varyings>
+	static inline void processVertex(const DrawcallSetting &drawCall, const TRVertex &vertex, TRShadingPipeline::VertexData &v)
+	{
+		v.m_pos = vertex.m_vpositions;
+		v.m_nor = vertex.m_vnormals;
+		v.m_tex = vertex.m_vtexcoords;
+		if (Varyings & TR_VARYING_TBN)
+		{
+			v.m_tbn[0] = vertex.m_vtangent;
+			v.m_tbn[1] = vertex.m_vbitangent;
+		}
+		drawCall.m_shaderHandler->vertexShader(v);
+	}
+
+	//Post-transform vertex cache: each unique vertex of the draw call is shaded exactly once,
+	//instead of once per face sharing it.
+	//Note: vertices are shaded in batches by the batch vertex shader, which only outputs the varyings of the 
+	//      interpolant layout of the draw call (e.g. positions of the depth only and visibility passes)
+	static void processVertices(const DrawcallSetting &drawCall, std::vector<TRShadingPipeline::VertexData> &shadedVertices)
+	{
+		const auto &vertexBuffer = drawCall.m_vertexBuffer;
+		if (shadedVertices.size() < vertexBuffer.size())
+			shadedVertices.resize(vertexBuffer.size());
+		const size_t numBatches = (vertexBuffer.size() + VERTEX_BATCH_SIZE - 1) / VERTEX_BATCH_SIZE;
+		parallelFor((size_t)0, numBatches, [&](const size_t &batch)
+		{
+			const size_t begin = batch * VERTEX_BATCH_SIZE;
+			const size_t count = std::min<size_t>(VERTEX_BATCH_SIZE, vertexBuffer.size() - begin);
+			drawCall.m_shaderHandler->vertexShaderBatch(&vertexBuffer[begin], count, &shadedVertices[begin], drawCall.m_varyings);
+		}, TRExecutionPolicy::TR_PARALLEL);
+	}
+
+	//Vertex transformation, cliping, perspective division, viewport transformation and culling of a face.
+	//Note: each survived screen space triangle is handed to func(v0, v1, v2) in order.
+	template<unsigned int Varyings, typename TriangleFunc>
+	static void processFaceGeometry(const DrawcallSetting &drawCall, int faceIndex, const TriangleFunc &func)
+	{
+		faceIndex *= 3;
+
+		TRShadingPipeline::VertexData v[3];
+		const auto &indexBuffer = drawCall.m_indexBuffer;
+		const auto &vertexBuffer = drawCall.m_vertexBuffer;
+#pragma unroll 3
+		for (int i = 0; i < 3; ++i)
+		{
+			if (drawCall.m_shadedVertices != nullptr)
+				v[i] = drawCall.m_shadedVertices[indexBuffer[faceIndex + i]];
+			else
+				processVertex<Varyings>(drawCall, vertexBuffer[indexBuffer[faceIndex + i]], v[i]);
+		}
+
+		//Homogeneous space cliping
+		//Note: the parts beyond the viewport but inside the guard band are left to the rasterizer
+		TRShadingPipeline::VertexData clipped_vertices[TRRenderer::k_maxClippedVertices];
+		const int num_verts = TRRenderer::clipingSutherlandHodgeman<Varyings>(v[0], v[1], v[2], 
+			drawCall.m_near, drawCall.m_far, drawCall.m_guardBand, clipped_vertices);
+		if (num_verts == 0)
+		{
+			return; //Totally outside
+		}
+
+		//Perspective division: from clip space -> ndc space
+		for (int i = 0; i < num_verts; ++i)
+		{
+			auto &vert = clipped_vertices[i];
+			TRShadingPipeline::VertexData::prePerspCorrection<Varyings>(vert);
+			vert.m_cpos *= vert.m_rhw;
+		}
+
+		for (int i = 0; i < num_verts - 2; ++i)
 		{
-			m_mutexBuffer.resize(width * height, nullptr);
-			for (int i = 0; i < width * height; ++i)
+			//Triangle assembly
+			TRShadingPipeline::VertexData vert[3] = { clipped_vertices[0], clipped_vertices[i + 1], clipped_vertices[i + 2] };
+
+			//Transform to screen space
+			vert[0].m_spos = snapToSubPixel(drawCall.m_viewportMatrix * vert[0].m_cpos, drawCall.m_subPixelBits);
+			vert[1].m_spos = snapToSubPixel(drawCall.m_viewportMatrix * vert[1].m_cpos, drawCall.m_subPixelBits);
+			vert[2].m_spos = snapToSubPixel(drawCall.m_viewportMatrix * vert[2].m_cpos, drawCall.m_subPixelBits);
+
+			//Backface culling
+			if (shouldCulled(vert[0].m_spos, vert[1].m_spos, vert[2].m_spos, drawCall.m_shadingState.m_trCullFaceMode))
 			{
-				m_mutexBuffer[i] = new MutexType();
+				continue;
 			}
+
+			func(vert[0], vert[1], vert[2]);
+		}
+	}
+
+	//----------------------------------------------FragmentProcessing----------------------------------------------
+	//Depth testing of the sampling points of a fragment, returns the coverage that passes the testing.
+	//Note: depth receives the depths rounded to the precision of the depth format, the same as the stored one
+	template<int Samples>
+	static inline unsigned int depthTestFragment(const DrawcallSetting &drawCall, const glm::ivec2 &fragCoord,
+		unsigned int coverage, const float *coverageDepth, float *depth)
+	{
+		auto &framebuffer = drawCall.m_frameBuffer;
+		const auto &shadingState = drawCall.m_shadingState;
+
+		const int samplingNum = Samples;
+
+#pragma unroll
+		for (int s = 0; s < samplingNum; ++s)
+		{
+			depth[s] = framebuffer->quantizeDepth(coverageDepth[s]);
 		}
 
-		~FramebufferMutex()
+		//Depth testing for each sampling point (Early Z strategy herein)
+		if (shadingState.m_trDepthTestMode == TRDepthTestMode::TR_DEPTH_TEST_ENABLE)
 		{
-			for (auto &mutex : m_mutexBuffer)
+			const bool equalFunc = shadingState.m_trDepthFunc == TRDepthFunc::TR_DEPTH_FUNC_EQUAL;
+#pragma unroll
+			for (int s = 0; s < samplingNum; ++s)
 			{
-				delete mutex;
-				mutex = nullptr;
+				if ((coverage & (1u << s)) == 0)
+					continue;
+				const float readDepth = framebuffer->readDepth(fragCoord.x, fragCoord.y, s);
+				if (equalFunc ? (readDepth != depth[s]) : (readDepth >= depth[s]))
+				{
+					coverage &= ~(1u << s);//Occuluded
+				}
+			}
+		}
+
+		return coverage;
+	}
+
+	//Alpha to coverage, color writing and depth writing of a shaded fragment.
+	//Note: depth should be the one returned by depthTestFragment()
+	template<int Samples>
+	static inline void writeFragment(const DrawcallSetting &drawCall, const glm::ivec2 &fragCoord,
+		unsigned int coverage, const float *depth, const glm::vec4 &fragColor)
+	{
+		auto &framebuffer = drawCall.m_frameBuffer;
+		const auto &shadingState = drawCall.m_shadingState;
+
+		const int samplingNum = Samples;
+
+		//Alpha to coverage
+		//Note: alpha to coverage only work with MSAA
+		//Refs: http://www.zwqxin.com/archives/opengl/talk-about-alpha-to-coverage.html
+		if (shadingState.m_trAlphaBlendMode == TRAlphaBlendingMode::TR_ALPHA_TO_COVERAGE && samplingNum > 1)
+		{
+			//Note: alpha could be out of [0,1] (e.g. HDR textures), the shift below needs [0,samplingNum]
+			int num_cancle = glm::clamp(samplingNum - int(samplingNum * fragColor.a), 0, samplingNum);
+			//None left, just discard in advance
+			if (num_cancle == samplingNum)
+			{
+				return;
 			}
+			coverage &= ~((1u << num_cancle) - 1);
 		}
 
-		MutexType &getLocker(const int &x, const int &y)
+		//Save the rendered result to frame buffer
+		//Note: the coverage bitmask is exactly the writing mask of the sampling points
+		switch (shadingState.m_trAlphaBlendMode)
 		{
-			return *m_mutexBuffer[y * m_width + x];
+		case TRAlphaBlendingMode::TR_ALPHA_DISABLE://No alpha blending
+		case TRAlphaBlendingMode::TR_ALPHA_TO_COVERAGE://Or alpha to coverage
+			framebuffer->writeColorWithMask(fragCoord.x, fragCoord.y, fragColor, coverage);
+			break;
+		case TRAlphaBlendingMode::TR_ALPHA_BLENDING://Alpha blending
+			framebuffer->writeColorWithMaskAlphaBlending(fragCoord.x, fragCoord.y, fragColor, coverage);
+			break;
+		default:
+			framebuffer->writeColorWithMask(fragCoord.x, fragCoord.y, fragColor, coverage);
+			break;
 		}
 
-	public:
-		using MutexBuffer = std::vector<MutexType*>;
-		int m_width, m_height;
-		MutexBuffer m_mutexBuffer;
-	};
+		//Depth writing
+		if (shadingState.m_trDepthWriteMode == TRDepthWriteMode::TR_DEPTH_WRITE_ENABLE)
+		{
+			framebuffer->writeDepthWithMask(fragCoord.x, fragCoord.y, depth, coverage);
+		}
+	}
+
+	//Depth testing, fragment shader execution and framebuffer writing of the 2x2 fragments block q of stream.
+	//Note: the surviving fragments are shaded at once by fragmentShaderQuad(), hence the caller should
+	//      guarantee exclusive access to the framebuffer of the whole block (e.g. a screen tile or its lock)
+	template<int Samples>
+	static void processQuad(const DrawcallSetting &drawCall, const TRShadingPipeline::QuadFragmentStream &stream,
+		const size_t &q)
+	{
+		const auto &shadingState = drawCall.m_shadingState;
+		const glm::ivec2 &quadPos = stream.getQuadPos(q);
+
+		float depth[4][Samples];
+		unsigned int coverage[4];
+		unsigned int mask = 0;
+#pragma unroll 4
+		for (int f = 0; f < 4; ++f)
+		{
+			//Note: zero coverage -> helper fragment
+			coverage[f] = stream.getCoverage(q, f);
+			if (coverage[f] == 0)
+				continue;
+			coverage[f] = depthTestFragment<Samples>(drawCall, quadPos + glm::ivec2(f & 1, f >> 1), coverage[f],
+				stream.getCoverageDepth(q, f), depth[f]);
+			mask |= (coverage[f] != 0) ? (1u << f) : 0u;
+		}
+
+		//No valid mask, just discard.
+		if (mask == 0)
+			return;
+
+		//Depth only (e.g. depth pre-pass), no need to execute fragment shader
+		if (shadingState.m_trColorWriteMode == TRColorWriteMode::TR_COLOR_WRITE_DISABLE)
+		{
+			if (shadingState.m_trDepthWriteMode == TRDepthWriteMode::TR_DEPTH_WRITE_ENABLE)
+			{
+				for (int f = 0; f < 4; ++f)
+				{
+					if (mask & (1u << f))
+					{
+						const glm::ivec2 fragCoord = quadPos + glm::ivec2(f & 1, f >> 1);
+						drawCall.m_frameBuffer->writeDepthWithMask(fragCoord.x, fragCoord.y, depth[f], coverage[f]);
+					}
+				}
+			}
+			return;
+		}
+
+		//Execute fragment shader for the block, the helper fragments are fetched for the quad texture sampling
+		TRShadingPipeline::FragmentData fragments[4];
+		glm::vec4 fragColor[4];
+#pragma unroll 4
+		for (int f = 0; f < 4; ++f)
+		{
+			stream.fetchFragment(q, f, fragments[f]);
+		}
+		drawCall.m_shaderHandler->fragmentShaderQuad(fragments, mask, fragColor, stream.dUVdx(q), stream.dUVdy(q));
+
+		//Save the results to frame buffer
+		for (int f = 0; f < 4; ++f)
+		{
+			if (mask & (1u << f))
+			{
+				writeFragment<Samples>(drawCall, fragments[f].m_spos, coverage[f], depth[f], fragColor[f]);
+			}
+		}
+	}
 
 	//----------------------------------------------TBBVertexRastFilter----------------------------------------------
 	//Vertex transformation, cliping, culling and rasterization.
+	template<unsigned int Varyings, int Samples>
 	class TBBVertexRastFilter final
 	{
 	public:
 		explicit TBBVertexRastFilter(int bs, int startIndex, int overIndex, const DrawcallSetting &drawcall,
-			FragmentCache &cache) : m_batchSize(bs), m_startIndex(startIndex), m_overIndex(overIndex),
-			m_drawCall(drawcall), m_fragmentCache(cache)
+			FragmentCache &cache, std::atomic<int> &currIndex) : m_batchSize(bs), m_startIndex(startIndex),
+			m_overIndex(overIndex), m_drawCall(drawcall), m_fragmentCache(cache), m_currIndex(currIndex)
 		{
 			m_currIndex.store(startIndex);
 		}
@@ -106,77 +346,21 @@ namespace TinyRenderer
 
 			//The fragment cache index
 			int order = faceIndex - m_startIndex;
-			faceIndex *= 3;
-
-			TRShadingPipeline::VertexData v[3];
-			const auto &indexBuffer = m_drawCall.m_indexBuffer;
-			const auto &vertexBuffer = m_drawCall.m_vertexBuffer;
-#pragma unroll 3
-			for (int i = 0; i < 3; ++i)
-			{
-				v[i].m_pos = vertexBuffer[indexBuffer[faceIndex + i]].m_vpositions;
-				v[i].m_nor = vertexBuffer[indexBuffer[faceIndex + i]].m_vnormals;
-				v[i].m_tex = vertexBuffer[indexBuffer[faceIndex + i]].m_vtexcoords;
-				v[i].m_tbn[0] = vertexBuffer[indexBuffer[faceIndex + i]].m_vtangent;
-				v[i].m_tbn[1] = vertexBuffer[indexBuffer[faceIndex + i]].m_vbitangent;
-			}
-
-			//Vertex shader stage
-			m_drawCall.m_shaderHandler->vertexShader(v[0]);
-			m_drawCall.m_shaderHandler->vertexShader(v[1]);
-			m_drawCall.m_shaderHandler->vertexShader(v[2]);
-
-			//Homogeneous space cliping
-			std::vector<TRShadingPipeline::VertexData> clipped_vertices;
-			clipped_vertices = TRRenderer::clipingSutherlandHodgeman(v[0], v[1], v[2], m_drawCall.m_near, m_drawCall.m_far);
-			if (clipped_vertices.empty())
-			{
-				return -1; //Totally outside
-			}
-
-			//Perspective division: from clip space -> ndc space
-			for (auto &vert : clipped_vertices)
-			{
-				TRShadingPipeline::VertexData::prePerspCorrection(vert);
-				vert.m_cpos *= vert.m_rhw;
-			}
 
-			int num_verts = clipped_vertices.size();
-			for (int i = 0; i < num_verts - 2; ++i)
+			//Geometry processing & rasterization
+			auto &fragments = m_fragmentCache[order];
+			fragments.setVaryings(Varyings);
+			fragments.setSamplingNum(Samples);
+			const int width = m_drawCall.m_frameBuffer->getWidth();
+			const int height = m_drawCall.m_frameBuffer->getHeight();
+			processFaceGeometry<Varyings>(m_drawCall, faceIndex, [&](const TRShadingPipeline::VertexData &v0,
+				const TRShadingPipeline::VertexData &v1, const TRShadingPipeline::VertexData &v2)
 			{
-				//Triangle assembly
-				TRShadingPipeline::VertexData vert[3] = { clipped_vertices[0], clipped_vertices[i + 1], clipped_vertices[i + 2] };
-
-				//Transform to screen space
-				vert[0].m_spos = glm::ivec2(m_drawCall.m_viewportMatrix * vert[0].m_cpos + glm::vec4(0.5f));
-				vert[1].m_spos = glm::ivec2(m_drawCall.m_viewportMatrix * vert[1].m_cpos + glm::vec4(0.5f));
-				vert[2].m_spos = glm::ivec2(m_drawCall.m_viewportMatrix * vert[2].m_cpos + glm::vec4(0.5f));
-
-				//Backface culling
-				if (shouldCulled(vert[0].m_spos, vert[1].m_spos, vert[2].m_spos, m_drawCall.m_shadingState.m_trCullFaceMode))
-				{
-					continue;
-				}
+				TRShadingPipeline::rasterizeFillEdgeFunction<Varyings, Samples>(v0, v1, v2, width, height, fragments, 
+					m_drawCall.m_hizBuffer, m_drawCall.m_shadingState.m_trDepthFunc);
+			});
 
-				//Rasterization
-				TRShadingPipeline::rasterizeFillEdgeFunction(vert[0], vert[1], vert[2],
-					m_drawCall.m_frameBuffer->getWidth(), m_drawCall.m_frameBuffer->getHeight(), m_fragmentCache[order]);
-			}
-
-			return order;
-		}
-
-	private:
-
-		static inline bool shouldCulled(const glm::ivec2 &v0, const glm::ivec2 &v1, const glm::ivec2 &v2, TRCullFaceMode mode)
-		{
-			if (mode == TRCullFaceMode::TR_CULL_DISABLE)
-				return false;
-			//Back face culling in screen space
-			auto e1 = v1 - v0;
-			auto e2 = v2 - v0;
-			int orient = e1.x * e2.y - e1.y * e2.x;
-			return (mode == TRCullFaceMode::TR_CULL_BACK) ? orient > 0 : orient < 0;
+			return fragments.empty() ? -1 : order;
 		}
 
 	private:
@@ -185,20 +369,20 @@ namespace TinyRenderer
 		const int m_overIndex;
 		const DrawcallSetting &m_drawCall;
 
-		//this is for excessively accessing to face among threads
-		static std::atomic<int> m_currIndex;
-
 		FragmentCache &m_fragmentCache;
-	};
 
-	std::atomic<int> TBBVertexRastFilter::m_currIndex;
+		//this is for excessively accessing to face among threads
+		//Note: owned by the draw call instead of being static, so that renderers could draw simultaneously
+		std::atomic<int> &m_currIndex;
+	};
 
 	//----------------------------------------------TBBFragmentFilter----------------------------------------------
 	//Fragment shader execution
+	template<int Samples>
 	class TBBFragmentFilter final
 	{
 	public:
-		explicit TBBFragmentFilter(int bs, const DrawcallSetting &drawcall, FragmentCache &cache, FramebufferMutex &fbMutex)
+		explicit TBBFragmentFilter(int bs, const DrawcallSetting &drawcall, FragmentCache &cache, TRFrameBufferMutex &fbMutex)
 			: m_batchSize(bs), m_drawCall(drawcall), m_fragmentCache(cache), m_framebufferMutex(fbMutex) {}
 
 		void operator()(int index) const
@@ -208,119 +392,392 @@ namespace TinyRenderer
 				return;
 
 			//Fragment shader & Depth testing
-			auto fragment_func = [&](TRShadingPipeline::FragmentData &fragment, const glm::vec2 &dUVdx, const glm::vec2 &dUVdy)
+			const auto &fragments = m_fragmentCache[index];
+			parallelFor((size_t)0, fragments.size(), [&](const size_t &q)
 			{
-				//Note: spos.x equals -1 -> invalid fragment
-				if (fragment.m_spos.x == -1)
-					return;
+				//A mutex locker herein for the 2x2 fragments block to prevent from simultanenously accessing depth buffer at the same place
+				//Note: the block starts at even coordinates, hence its 4 pixels share the same lock
+				const glm::ivec2 &quadPos = fragments.getQuadPos(q);
+				MutexType::scoped_lock lock(m_framebufferMutex.getLocker(quadPos.x, quadPos.y));
 
-				auto &coverage = fragment.m_coverage;
-				const auto &fragCoord = fragment.m_spos;
-				auto &framebuffer = m_drawCall.m_frameBuffer;
-				const auto &shadingState = m_drawCall.m_shadingState;
+				processQuad<Samples>(m_drawCall, fragments, q);
+			}, TRExecutionPolicy::TR_PARALLEL);
 
-				//A mutex locker herein for (x,y) to prevent from simultanenously accessing depth buffer at the same place
-				MutexType::scoped_lock lock(m_framebufferMutex.getLocker(fragCoord.x, fragCoord.y));
+			m_fragmentCache[index].clear();
+		}
+
+	private:
+		int m_batchSize;
+		const DrawcallSetting &m_drawCall;
+		FragmentCache &m_fragmentCache;
+		TRFrameBufferMutex &m_framebufferMutex;
+	};
 
-				const int samplingNum = TRMaskPixelSampler::getSamplingNum();
+	//Faces in [startIndex, overIndex) are streamed through the parallel pipeline
+	template<unsigned int Varyings, int Samples>
+	static void renderFacesPipeline(const DrawcallSetting &drawCall, int startIndex, int overIndex, int ntokens,
+		tbb::filter_mode executeMode, FragmentCache &cache, TRFrameBufferMutex &fbMutex)
+	{
+		std::atomic<int> currIndex(startIndex);
+		tbb::parallel_pipeline(ntokens, //Number of tokens
+			//Note: Vertex shader and rasterization could be parallelized
+			tbb::make_filter<void, int>(executeMode,
+				TBBVertexRastFilter<Varyings, Samples>(PIPELINE_BATCH_SIZE, startIndex, overIndex, drawCall, cache, currIndex)) &
+			//Note: Fragment shaders between different faces could parallelized
+			//      because a mutex lock for framebuffer could avoid conflicts
+			tbb::make_filter<int, void>(executeMode,
+				TBBFragmentFilter<Samples>(PIPELINE_BATCH_SIZE, drawCall, cache, fbMutex)));
+	}
 
-				int num_failed = 0;
-				//Depth testing for each sampling point (Early Z strategy herein)
-				if (shadingState.m_trDepthTestMode == TRDepthTestMode::TR_DEPTH_TEST_ENABLE)
+	//----------------------------------------------TileBinning----------------------------------------------
+	//Sort-middle rasterization: the geometry stage bins the screen space triangles into tiles,
+	//and then each tile is rasterized and shaded by exactly one thread, hence no locks at all.
+	//Refs: Molnar S, Cox M, Ellsworth D, et al. A sorting classification of parallel rendering[J].
+	//      IEEE Computer Graphics and Applications, 1994, 14(4): 23-32.
+	//Geometry & binning stage of faces in [startIndex, overIndex)
+	template<unsigned int Varyings>
+	static void binFacesToTiles(const DrawcallSetting &drawCall, int startIndex, int overIndex,
+		TRTileBinningCache &cache)
+	{
+		const int tileSize = TRTileBinningCache::k_tileSize;
+		const int width = drawCall.m_frameBuffer->getWidth();
+		const int height = drawCall.m_frameBuffer->getHeight();
+		const int numTilesX = (width + tileSize - 1) / tileSize;
+		const int numTilesY = (height + tileSize - 1) / tileSize;
+		const int numFaces = overIndex - startIndex;
+
+		auto &binnedFaces = cache.m_binnedFaces;
+		auto &tileBins = cache.m_tileBins;
+		if (binnedFaces.size() < (size_t)numFaces)
+			binnedFaces.resize(numFaces);
+		if (tileBins.size() != (size_t)(numTilesX * numTilesY))
+			tileBins.resize(numTilesX * numTilesY);
+
+		//Geometry stage: each face is processed independently
+		parallelFor((int)0, numFaces, [&](const int &f)
+		{
+			auto &triangles = binnedFaces[f];
+			triangles.clear();
+			processFaceGeometry<Varyings>(drawCall, startIndex + f, [&](const TRShadingPipeline::VertexData &v0,
+				const TRShadingPipeline::VertexData &v1, const TRShadingPipeline::VertexData &v2)
+			{
+				triangles.push_back(v0);
+				triangles.push_back(v1);
+				triangles.push_back(v2);
+			});
+		}, TRExecutionPolicy::TR_PARALLEL);
+
+		//Binning stage
+		//Note: faces are binned in submission order, so that each tile keeps the drawing order (for alpha blending)
+		for (int f = 0; f < numFaces; ++f)
+		{
+			const auto &triangles = binnedFaces[f];
+			for (size_t t = 0; t < triangles.size(); t += 3)
+			{
+				const auto &p0 = triangles[t + 0].m_spos;
+				const auto &p1 = triangles[t + 1].m_spos;
+				const auto &p2 = triangles[t + 2].m_spos;
+				int minX = glm::max(subPixelToPixelMin(glm::min(p0.x, glm::min(p1.x, p2.x))), 0);
+				int minY = glm::max(subPixelToPixelMin(glm::min(p0.y, glm::min(p1.y, p2.y))), 0);
+				int maxX = glm::min(subPixelToPixelMax(glm::max(p0.x, glm::max(p1.x, p2.x))), width - 1);
+				int maxY = glm::min(subPixelToPixelMax(glm::max(p0.y, glm::max(p1.y, p2.y))), height - 1);
+				if (minX > maxX || minY > maxY)
+					continue;
+				const TRTileBinningCache::BinnedTriangle binned = { &triangles[t],
+					(static_cast<unsigned int>(startIndex + f) << 4) | static_cast<unsigned int>(t / 3) };
+				for (int ty = minY / tileSize; ty <= maxY / tileSize; ++ty)
 				{
-					const auto &coverageDepth = fragment.m_coverageDepth;
-#pragma unroll
-					for (int s = 0; s < samplingNum; ++s)
+					for (int tx = minX / tileSize; tx <= maxX / tileSize; ++tx)
 					{
-						if (coverage[s] == 1 &&
-							framebuffer->readDepth(fragCoord.x, fragCoord.y, s) >= coverageDepth[s])
-						{
-							coverage[s] = 0;//Occuluded
-							++num_failed;
-						}
-						else if (coverage[s] == 0)
-						{
-							++num_failed;
-						}
+						tileBins[ty * numTilesX + tx].push_back(binned);
 					}
 				}
+			}
+		}
+	}
 
-				//No valid mask, just discard.
-				if (num_failed == samplingNum)
-					return;
+	template<unsigned int Varyings, int Samples>
+	static void renderFacesTileBinning(const DrawcallSetting &drawCall, int startIndex, int overIndex,
+		TRTileBinningCache &cache)
+	{
+		const int tileSize = TRTileBinningCache::k_tileSize;
+		const int width = drawCall.m_frameBuffer->getWidth();
+		const int height = drawCall.m_frameBuffer->getHeight();
+		const int numTilesX = (width + tileSize - 1) / tileSize;
+		const int numTilesY = (height + tileSize - 1) / tileSize;
+		auto &tileBins = cache.m_tileBins;
+
+		binFacesToTiles<Varyings>(drawCall, startIndex, overIndex, cache);
+
+		//Rasterization & fragment stage: tile-exclusive, no framebuffer mutex needed,
+		//hence the 2x2 fragments blocks are shaded at once
+		parallelFor((int)0, numTilesX * numTilesY, [&](const int &tile)
+		{
+			auto &bin = tileBins[tile];
+			if (bin.empty())
+				return;
 
-				//Execute fragment shader, and save the result to frame buffer
-				glm::vec4 fragColor;
-				m_drawCall.m_shaderHandler->fragmentShader(fragment, fragColor, dUVdx, dUVdy);
+			const glm::ivec2 tileMin((tile % numTilesX) * tileSize, (tile / numTilesX) * tileSize);
+			const glm::ivec2 tileMax(glm::min(tileMin.x + tileSize, width) - 1, glm::min(tileMin.y + tileSize, height) - 1);
 
-				//Alpha to coverage
-				//Note: alpha to coverage only work with MSAA
-				//Refs: http://www.zwqxin.com/archives/opengl/talk-about-alpha-to-coverage.html
-				if (shadingState.m_trAlphaBlendMode == TRAlphaBlendingMode::TR_ALPHA_TO_COVERAGE && samplingNum >= 4)
+			auto &fragments = cache.m_tileFragments.local();
+			fragments.setVaryings(Varyings);
+			fragments.setSamplingNum(Samples);
+			for (const auto &binned : bin)
+			{
+				const auto *tri = binned.m_vertices;
+				fragments.clear();
+				TRShadingPipeline::rasterizeFillEdgeFunction<Varyings, Samples>(tri[0], tri[1], tri[2], tileMin, tileMax, fragments,
+					drawCall.m_hizBuffer, drawCall.m_shadingState.m_trDepthFunc);
+				for (size_t q = 0; q < fragments.size(); ++q)
 				{
-					int num_cancle = samplingNum  - int(samplingNum * fragColor.a);
-					//None left, just discard in advance
-					if (num_cancle == samplingNum)
-					{
-						return;
-					}
-					for (int c = 0; c < num_cancle; ++c)
+					processQuad<Samples>(drawCall, fragments, q);
+				}
+			}
+			bin.clear();
+		}, TRExecutionPolicy::TR_PARALLEL);
+	}
+
+	//----------------------------------------------VisibilityBuffer----------------------------------------------
+	//Deferred rendering: the tile binned triangles only write depth and ids to the visibility buffer,
+	//then the materials are shaded once per visible triangle of each 2x2 pixels block.
+	template<int Samples>
+	static void renderFacesVisibility(const DrawcallSetting &drawCall, int startIndex, int overIndex, const int &drawId,
+		TRTileBinningCache &cache, TRVisibilityBuffer &visibility)
+	{
+		const int tileSize = TRTileBinningCache::k_tileSize;
+		const int width = drawCall.m_frameBuffer->getWidth();
+		const int height = drawCall.m_frameBuffer->getHeight();
+		const int numTilesX = (width + tileSize - 1) / tileSize;
+		const int numTilesY = (height + tileSize - 1) / tileSize;
+		const int samplingNum = Samples;
+		auto &tileBins = cache.m_tileBins;
+		auto &framebuffer = drawCall.m_frameBuffer;
+
+		//Note: only positions are needed
+		binFacesToTiles<TRShadingPipeline::k_varyingsNone>(drawCall, startIndex, overIndex, cache);
+
+		parallelFor((int)0, numTilesX * numTilesY, [&](const int &tile)
+		{
+			auto &bin = tileBins[tile];
+			if (bin.empty())
+				return;
+
+			const glm::ivec2 tileMin((tile % numTilesX) * tileSize, (tile / numTilesX) * tileSize);
+			const glm::ivec2 tileMax(glm::min(tileMin.x + tileSize, width) - 1, glm::min(tileMin.y + tileSize, height) - 1);
+
+			auto &fragments = cache.m_tileFragments.local();
+			fragments.setVaryings(TRShadingPipeline::k_varyingsNone);
+			fragments.setSamplingNum(Samples);
+			for (const auto &binned : bin)
+			{
+				const auto *tri = binned.m_vertices;
+				const uint64_t id = TRVisibilityBuffer::packId(drawId, binned.m_primitiveId);
+				fragments.clear();
+				TRShadingPipeline::rasterizeFillEdgeFunction<TRShadingPipeline::k_varyingsNone, Samples>(tri[0], tri[1], tri[2],
+					tileMin, tileMax, fragments, drawCall.m_hizBuffer, drawCall.m_shadingState.m_trDepthFunc);
+				for (size_t q = 0; q < fragments.size(); ++q)
+				{
+					for (int f = 0; f < 4; ++f)
 					{
-						coverage[c] = 0;
+						const unsigned int coverage = fragments.getCoverage(q, f);
+						if (coverage == 0)
+							continue;
+						const float *coverageDepth = fragments.getCoverageDepth(q, f);
+						const glm::ivec2 pos = fragments.getQuadPos(q) + glm::ivec2(f & 1, f >> 1);
+						for (int s = 0; s < samplingNum; ++s)
+						{
+							//Depth testing
+							if ((coverage & (1u << s)) == 0)
+								continue;
+							const float depth = framebuffer->quantizeDepth(coverageDepth[s]);
+							if (framebuffer->readDepth(pos.x, pos.y, s) < depth)
+							{
+								framebuffer->writeDepth(pos.x, pos.y, s, depth);
+								visibility.write(pos.x, pos.y, s, id);
+							}
+						}
 					}
 				}
+			}
+			bin.clear();
+		}, TRExecutionPolicy::TR_PARALLEL);
+	}
+
+	//Material shading of the quads whose visible triangles belong to the draw call drawId
+	//Note: the triangles are reconstructed from the vertex buffer and index buffer
+	template<unsigned int Varyings, int Samples>
+	static void shadeVisibilityBuffer(const DrawcallSetting &drawCall, const int &drawId, 
+		TRTileBinningCache &cache, TRVisibilityBuffer &visibility)
+	{
+		const int samplingNum = Samples;
+		const int width = drawCall.m_frameBuffer->getWidth();
+		const int height = drawCall.m_frameBuffer->getHeight();
+
+		//Note: the quads of each tile are sorted by id, hence the ones of drawId are contiguous from the cursor
+		parallelFor((int)0, (int)visibility.m_tileQuads.size(), [&](const int &tile)
+		{
+			const auto &quads = visibility.m_tileQuads[tile];
+			auto &cursor = visibility.m_tileCursor[tile];
+			if (cursor >= quads.size() || TRVisibilityBuffer::unpackDrawId(quads[cursor].m_id) != drawId)
+				return;
 
-				//Save the rendered result to frame buffer
-				switch (shadingState.m_trAlphaBlendMode)
+			auto &fragments = cache.m_tileFragments.local();
+			fragments.setVaryings(Varyings);
+			fragments.setSamplingNum(Samples);
+			uint64_t triangleId = 0;
+			TRShadingPipeline::VertexData tri[3];
+			float coverageDepth[4 * samplingNum];
+			for (; cursor < quads.size() && TRVisibilityBuffer::unpackDrawId(quads[cursor].m_id) == drawId; ++cursor)
+			{
+				const auto &quad = quads[cursor];
+				if (quad.m_id != triangleId)
 				{
-				case TRAlphaBlendingMode::TR_ALPHA_DISABLE://No alpha blending
-				case TRAlphaBlendingMode::TR_ALPHA_TO_COVERAGE://Or alpha to coverage
-					framebuffer->writeColorWithMask(fragCoord.x, fragCoord.y, fragColor, coverage);
-					break;
-				case TRAlphaBlendingMode::TR_ALPHA_BLENDING://Alpha blending
-					framebuffer->writeColorWithMaskAlphaBlending(fragCoord.x, fragCoord.y, fragColor, coverage);
-					break;
-				default:
-					framebuffer->writeColorWithMask(fragCoord.x, fragCoord.y, fragColor, coverage);
-					break;
+					//Reconstruct the visible triangle, i.e. the clipped triangle k of the face
+					const unsigned int primitiveId = TRVisibilityBuffer::unpackPrimitiveId(quad.m_id);
+					unsigned int k = 0;
+					processFaceGeometry<Varyings>(drawCall, primitiveId >> 4, [&](const TRShadingPipeline::VertexData &v0,
+						const TRShadingPipeline::VertexData &v1, const TRShadingPipeline::VertexData &v2)
+					{
+						if (k++ == (primitiveId & 15))
+						{
+							tri[0] = v0;
+							tri[1] = v1;
+							tri[2] = v2;
+						}
+					});
+					triangleId = quad.m_id;
 				}
 
-				//Depth writing
-				if (shadingState.m_trDepthWriteMode == TRDepthWriteMode::TR_DEPTH_WRITE_ENABLE)
+				for (int f = 0; f < 4; ++f)
 				{
-					framebuffer->writeDepthWithMask(fragCoord.x, fragCoord.y, fragment.m_coverageDepth, coverage);
+					const glm::ivec2 pos = quad.m_pos + glm::ivec2(f & 1, f >> 1);
+					for (int s = 0; s < samplingNum; ++s)
+					{
+						coverageDepth[f * samplingNum + s] = (pos.x < width && pos.y < height) ?
+							drawCall.m_frameBuffer->readDepth(pos.x, pos.y, s) : 0.0f;
+					}
 				}
-				
-			};
-
-			//Note: 2x2 fragment block as an execution unit for calculating dFdx, dFdy.
-			parallelFor((size_t)0, (size_t)m_fragmentCache[index].size(), [&](const size_t &f)
-			{
-				auto &block = m_fragmentCache[index][f];
 
-				//Perspective correction restore
-				block.aftPrespCorrectionForBlocks();
+				fragments.clear();
+				TRShadingPipeline::reconstructQuadFragments<Varyings>(tri[0], tri[1], tri[2], quad.m_pos, 
+					quad.m_coverage, coverageDepth, fragments);
+				processQuad<Samples>(drawCall, fragments, 0);
+			}
+		}, TRExecutionPolicy::TR_PARALLEL);
+	}
 
-				//Calculate dUVdx, dUVdy for mipmap
-				glm::vec2 dUVdx(block.dUdx(), block.dVdx());
-				glm::vec2 dUVdy(block.dUdy(), block.dVdy());
+	//----------------------------------------------DrawcallDispatch----------------------------------------------
+	//Implementations of a draw call specialized for the interpolant layout and the sampling number
+	struct DrawcallFuncs
+	{
+		void(*m_renderFacesPipeline)(const DrawcallSetting &, int, int, int, tbb::filter_mode, FragmentCache &, 
+			TRFrameBufferMutex &);
+		void(*m_renderFacesTileBinning)(const DrawcallSetting &, int, int, TRTileBinningCache &);
+		void(*m_renderFacesVisibility)(const DrawcallSetting &, int, int, const int &, TRTileBinningCache &, 
+			TRVisibilityBuffer &);
+		void(*m_shadeVisibilityBuffer)(const DrawcallSetting &, const int &, TRTileBinningCache &, TRVisibilityBuffer &);
+	};
 
-				fragment_func(block.m_fragments[0], dUVdx, dUVdy);
-				fragment_func(block.m_fragments[1], dUVdx, dUVdy);
-				fragment_func(block.m_fragments[2], dUVdx, dUVdy);
-				fragment_func(block.m_fragments[3], dUVdx, dUVdy);
+	template<unsigned int Varyings, int Samples>
+	static DrawcallFuncs getDrawcallFuncs()
+	{
+		return { &renderFacesPipeline<Varyings, Samples>, &renderFacesTileBinning<Varyings, Samples>,
+			&renderFacesVisibility<Samples>, &shadeVisibilityBuffer<Varyings, Samples> };
+	}
 
-			}, TRExecutionPolicy::TR_PARALLEL);
+	template<int Samples>
+	static DrawcallFuncs getDrawcallFuncs(const unsigned int &varyings)
+	{
+		switch (varyings)
+		{
+		case TRShadingPipeline::k_varyingsNone:
+			return getDrawcallFuncs<TRShadingPipeline::k_varyingsNone, Samples>();
+		case TRShadingPipeline::k_varyingsTexcoord:
+			return getDrawcallFuncs<TRShadingPipeline::k_varyingsTexcoord, Samples>();
+		case TRShadingPipeline::k_varyingsLighting:
+			return getDrawcallFuncs<TRShadingPipeline::k_varyingsLighting, Samples>();
+		default:
+			return getDrawcallFuncs<TRShadingPipeline::k_varyingsAll, Samples>();
+		}
+	}
 
-			m_fragmentCache[index].clear();
+	static DrawcallFuncs getDrawcallFuncs(const unsigned int &varyings, const int &samplingNum)
+	{
+		switch (samplingNum)
+		{
+		case TRMSAAMode::TR_MSAA_1X:
+			return getDrawcallFuncs<TRMSAAMode::TR_MSAA_1X>(varyings);
+		case TRMSAAMode::TR_MSAA_2X:
+			return getDrawcallFuncs<TRMSAAMode::TR_MSAA_2X>(varyings);
+		case TRMSAAMode::TR_MSAA_8X:
+			return getDrawcallFuncs<TRMSAAMode::TR_MSAA_8X>(varyings);
+		default:
+			return getDrawcallFuncs<TRMSAAMode::TR_MSAA_4X>(varyings);
 		}
+	}
 
-	private:
-		int m_batchSize;
-		const DrawcallSetting &m_drawCall;
-		FragmentCache &m_fragmentCache;
-		FramebufferMutex &m_framebufferMutex;
-	};
+	//----------------------------------------------TRVisibilityBuffer----------------------------------------------
+
+	void TRVisibilityBuffer::resize(const int &width, const int &height, const int &samplingNum)
+	{
+		const int tileSize = TRTileBinningCache::k_tileSize;
+		m_width = width;
+		m_height = height;
+		m_samplingNum = samplingNum;
+		m_ids.resize(width * height * samplingNum, 0);
+		m_tileQuads.resize(((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize));
+		m_tileCursor.resize(m_tileQuads.size(), 0);
+	}
+
+	void TRVisibilityBuffer::clear()
+	{
+		parallelFor((size_t)0, m_ids.size(), [&](const size_t &index)
+		{
+			m_ids[index] = 0;
+		});
+		m_numDraws = 0;
+	}
+
+	void TRVisibilityBuffer::gatherTileQuads(const int &tile, const glm::ivec2 &tileMin, const glm::ivec2 &tileMax)
+	{
+		auto &quads = m_tileQuads[tile];
+		quads.clear();
+		m_tileCursor[tile] = 0;
+		for (int y = tileMin.y; y <= tileMax.y; y += 2)
+		{
+			for (int x = tileMin.x; x <= tileMax.x; x += 2)
+			{
+				//Note: at most 4 * samplingNum different triangles in a quad
+				const size_t first = quads.size();
+				for (int f = 0; f < 4; ++f)
+				{
+					const int px = x + (f & 1), py = y + (f >> 1);
+					if (px > tileMax.x || py > tileMax.y)
+						continue;
+					for (int s = 0; s < m_samplingNum; ++s)
+					{
+						const uint64_t id = read(px, py, s);
+						if (id == 0)
+							continue;
+						const unsigned int bit = 1u << (f * m_samplingNum + s);
+						size_t q = first;
+						while (q < quads.size() && quads[q].m_id != id)
+							++q;
+						if (q == quads.size())
+							quads.push_back({ id, glm::ivec2(x, y), bit });
+						else
+							quads[q].m_coverage |= bit;
+					}
+				}
+			}
+		}
+		//Group by draw call and triangle
+		std::stable_sort(quads.begin(), quads.end(), [](const QuadVisibility &a, const QuadVisibility &b)
+		{
+			return a.m_id < b.m_id;
+		});
+	}
 
 	//----------------------------------------------TRRenderer----------------------------------------------
 
@@ -328,12 +785,19 @@ namespace TinyRenderer
 		: m_backBuffer(nullptr), m_frontBuffer(nullptr)
 	{
 		//Double buffer to avoid flickering
-		m_backBuffer = std::make_shared<TRFrameBuffer>(width, height);
-		m_frontBuffer = std::make_shared<TRFrameBuffer>(width, height);
+		createFrameBuffers(width, height);
 		m_renderedImg.resize(width * height * 3, 0);
 
+		//Setting for drawcall
+		m_numTokens = tbb::this_task_arena::max_concurrency() * 128;
+		m_fragmentCache.resize(PIPELINE_BATCH_SIZE);
+
 		//Setup viewport matrix (ndc space -> screen space)
 		m_viewportMatrix = TRMathUtils::calcViewPortMatrix(width, height);
+
+		//Guard band: screen = (ndc + 1) * size / 2 should be within [-k_guardBandExtent, k_guardBandExtent]
+		m_guardBand.x = glm::max(2.0f * k_guardBandExtent / width - 1.0f, 1.0f);
+		m_guardBand.y = glm::max(2.0f * k_guardBandExtent / height - 1.0f, 1.0f);
 	}
 
 	void TRRenderer::addDrawableMesh(TRDrawableMesh::ptr mesh)
@@ -355,18 +819,52 @@ namespace TinyRenderer
 		std::vector<TRDrawableMesh::ptr>().swap(m_drawableMeshes);
 	}
 
-	void TRRenderer::setViewerPos(const glm::vec3 &viewer)
+	void TRRenderer::setViewerPos(const glm::vec3 &viewer) { m_viewerPos = viewer; }
+
+	void TRRenderer::setMSAAMode(TRMSAAMode mode)
 	{
-		if (m_shaderHandler == nullptr)
+		if (mode == m_msaaMode)
 			return;
-		m_shaderHandler->setViewerPos(viewer);
+		//Note: the framebuffers are recreated for the new sampling number, hence the content is lost
+		m_msaaMode = mode;
+		createFrameBuffers(m_backBuffer->getWidth(), m_backBuffer->getHeight());
 	}
 
-	int TRRenderer::addLightSource(TRLight::ptr lightSource) { return TRShadingPipeline::addLight(lightSource); }
+	void TRRenderer::setDepthFormat(TRDepthFormat format, TRReverseZMode reverseZ)
+	{
+		if (format == m_depthFormat && reverseZ == m_reverseZMode)
+			return;
+		m_depthFormat = format;
+		m_reverseZMode = reverseZ;
+		createFrameBuffers(m_backBuffer->getWidth(), m_backBuffer->getHeight());
+	}
 
-	TRLight::ptr TRRenderer::getLightSource(const int &index) { return TRShadingPipeline::getLight(index); }
+	void TRRenderer::setProjectMatrix(const glm::mat4 &project, float near, float far)
+	{
+		m_projectMatrix = project;
+		m_frustumNearFar = glm::vec2(near, far);
+		//Note: the near plane normalizes the depth of the unorm formats
+		m_backBuffer->setDepthNear(near);
+		m_frontBuffer->setDepthNear(near);
+	}
 
-	void TRRenderer::setExposure(const float &exposure) { TRShadingPipeline::setExposure(exposure); }
+	void TRRenderer::createFrameBuffers(const int &width, const int &height)
+	{
+		m_backBuffer = std::make_shared<TRFrameBuffer>(width, height, m_msaaMode, m_depthFormat, m_reverseZMode);
+		m_frontBuffer = std::make_shared<TRFrameBuffer>(width, height, m_msaaMode, m_depthFormat, m_reverseZMode);
+		m_backBuffer->setDepthNear(m_frustumNearFar.x);
+		m_frontBuffer->setDepthNear(m_frustumNearFar.x);
+	}
+
+	int TRRenderer::addLightSource(TRLight::ptr lightSource)
+	{
+		m_lights.push_back(lightSource);
+		return m_lights.size() - 1;
+	}
+
+	TRLight::ptr TRRenderer::getLightSource(const int &index) { return m_lights[index]; }
+
+	void TRRenderer::setExposure(const float &exposure) { m_exposure = exposure; }
 
 	unsigned int TRRenderer::renderAllDrawableMeshes()
 	{
@@ -379,12 +877,64 @@ namespace TinyRenderer
 		m_shaderHandler->setModelMatrix(m_modelMatrix);
 		m_shaderHandler->setViewProjectMatrix(m_projectMatrix * m_viewMatrix);
 
+		//Load the lighting environment
+		m_shaderHandler->setLights(m_lights);
+		m_shaderHandler->setExposure(m_exposure);
+		m_shaderHandler->setViewerPos(m_viewerPos);
+
 		//Draw a mesh step by step
 		unsigned int num_triangles = 0;
 
-		for (size_t m = 0; m < m_drawableMeshes.size(); ++m)
+		if (m_renderingMode == TRRenderingMode::TR_RENDERING_VISIBILITY_BUFFER)
+		{
+			//Visibility pass: the opaque drawables only write depth and ids of the visible triangles
+			m_visibilityBuffer.resize(m_backBuffer->getWidth(), m_backBuffer->getHeight(), m_backBuffer->getSamplingNum());
+			m_visibilityBuffer.clear();
+			for (size_t m = 0; m < m_drawableMeshes.size(); ++m)
+			{
+				renderDrawableMesh(m, TR_PASS_VISIBILITY);
+			}
+
+			//Gather the visible triangles of each tile
+			const int tileSize = TRTileBinningCache::k_tileSize;
+			const int width = m_backBuffer->getWidth(), height = m_backBuffer->getHeight();
+			const int numTilesX = (width + tileSize - 1) / tileSize;
+			parallelFor((int)0, (int)m_visibilityBuffer.m_tileQuads.size(), [&](const int &tile)
+			{
+				const glm::ivec2 tileMin((tile % numTilesX) * tileSize, (tile / numTilesX) * tileSize);
+				const glm::ivec2 tileMax(glm::min(tileMin.x + tileSize, width) - 1, glm::min(tileMin.y + tileSize, height) - 1);
+				m_visibilityBuffer.gatherTileQuads(tile, tileMin, tileMax);
+			}, TRExecutionPolicy::TR_PARALLEL);
+
+			//Material pass, and then the drawables not deferred
+			m_visibilityBuffer.m_numDraws = 0;
+			for (size_t m = 0; m < m_drawableMeshes.size(); ++m)
+			{
+				num_triangles += renderDrawableMesh(m, TR_PASS_MATERIAL);
+			}
+			for (size_t m = 0; m < m_drawableMeshes.size(); ++m)
+			{
+				num_triangles += renderDrawableMesh(m, TR_PASS_FORWARD_REST);
+			}
+		}
+		else if (m_depthPrePassMode == TRDepthPrePassMode::TR_DEPTH_PREPASS_ENABLE)
+		{
+			//Lay down the depth first, hence each sampling point of the opaque drawables is shaded only once
+			for (size_t m = 0; m < m_drawableMeshes.size(); ++m)
+			{
+				renderDrawableMesh(m, TR_PASS_DEPTH_ONLY);
+			}
+			for (size_t m = 0; m < m_drawableMeshes.size(); ++m)
+			{
+				num_triangles += renderDrawableMesh(m, TR_PASS_DEPTH_EQUAL);
+			}
+		}
+		else
 		{
-			num_triangles += renderDrawableMesh(m);
+			for (size_t m = 0; m < m_drawableMeshes.size(); ++m)
+			{
+				num_triangles += renderDrawableMesh(m, TR_PASS_FORWARD);
+			}
 		}
 
 		//MSAA resolve stage
@@ -399,6 +949,11 @@ namespace TinyRenderer
 	}
 
 	unsigned int TRRenderer::renderDrawableMesh(const size_t &index)
+	{
+		return renderDrawableMesh(index, TR_PASS_FORWARD);
+	}
+
+	unsigned int TRRenderer::renderDrawableMesh(const size_t &index, const TRRenderPass &pass)
 	{
 		if (index >= m_drawableMeshes.size())
 			return 0;
@@ -412,6 +967,44 @@ namespace TinyRenderer
 		m_shadingState.m_trDepthTestMode = drawable->getDepthtestMode();
 		m_shadingState.m_trDepthWriteMode = drawable->getDepthwriteMode();
 		m_shadingState.m_trAlphaBlendMode = drawable->getAlphablendMode();
+		m_shadingState.m_trDepthFunc = TRDepthFunc::TR_DEPTH_FUNC_GREATER;
+		m_shadingState.m_trColorWriteMode = TRColorWriteMode::TR_COLOR_WRITE_ENABLE;
+
+		//Note: only the opaque drawables writing depth are deferred (i.e. depth pre-pass or visibility buffer),
+		//      the others are rendered forward in the shading pass
+		const bool deferred = pass != TR_PASS_FORWARD &&
+			m_shadingState.m_trDepthTestMode == TRDepthTestMode::TR_DEPTH_TEST_ENABLE &&
+			m_shadingState.m_trDepthWriteMode == TRDepthWriteMode::TR_DEPTH_WRITE_ENABLE &&
+			m_shadingState.m_trAlphaBlendMode == TRAlphaBlendingMode::TR_ALPHA_DISABLE;
+		switch (pass)
+		{
+		case TR_PASS_DEPTH_ONLY:
+		case TR_PASS_VISIBILITY:
+			if (!deferred)
+				return 0;
+			m_shadingState.m_trColorWriteMode = TRColorWriteMode::TR_COLOR_WRITE_DISABLE;
+			break;
+		case TR_PASS_DEPTH_EQUAL:
+			if (deferred)
+			{
+				m_shadingState.m_trDepthFunc = TRDepthFunc::TR_DEPTH_FUNC_EQUAL;
+				m_shadingState.m_trDepthWriteMode = TRDepthWriteMode::TR_DEPTH_WRITE_DISABLE;
+			}
+			break;
+		case TR_PASS_MATERIAL:
+			if (!deferred)
+				return 0;
+			//Note: the visibility has been resolved
+			m_shadingState.m_trDepthTestMode = TRDepthTestMode::TR_DEPTH_TEST_DISABLE;
+			m_shadingState.m_trDepthWriteMode = TRDepthWriteMode::TR_DEPTH_WRITE_DISABLE;
+			break;
+		case TR_PASS_FORWARD_REST:
+			if (deferred)
+				return 0;
+			break;
+		default:
+			break;
+		}
 
 		//Setup the shading options
 		m_shaderHandler->setModelMatrix(drawable->getModelMatrix());
@@ -427,11 +1020,6 @@ namespace TinyRenderer
 		tbb::filter_mode executeMopde = m_shadingState.m_trAlphaBlendMode == TRAlphaBlendingMode::TR_ALPHA_DISABLE ?
 			tbb::filter_mode::parallel : tbb::filter_mode::serial_in_order;
 
-		//Setting for drawcall
-		static int ntokens = tbb::this_task_arena::max_concurrency() * 128;
-		static FragmentCache fragmentCache;
-		static FramebufferMutex framebufferMutex(m_backBuffer->getWidth(), m_backBuffer->getHeight());
-
 		for (size_t s = 0; s < submeshes.size(); ++s)
 		{
 			const auto &submesh = submeshes[s];
@@ -446,22 +1034,61 @@ namespace TinyRenderer
 
 			//Draw call setting
 			DrawcallSetting drawCall(submesh.getVertices(), submesh.getIndices(), m_shaderHandler.get(),
-				m_shadingState, m_viewportMatrix, m_frustumNearFar.x, m_frustumNearFar.y, m_backBuffer.get());
-
-			for (int f = 0; f < faceNum; f += PIPELINE_BATCH_SIZE)
-			{
-				int startIndex = f;
-				int overIndex = glm::min(f + PIPELINE_BATCH_SIZE, faceNum);
-				tbb::parallel_pipeline(ntokens, //Number of tokens
-					//Note: Vertex shader and rasterization could be parallelized
-					tbb::make_filter<void, int>(executeMopde,
-						TBBVertexRastFilter(PIPELINE_BATCH_SIZE, startIndex, overIndex, drawCall, fragmentCache)) &
-					//Note: Fragment shaders between different faces could parallelized
-					//      because a mutex lock for framebuffer could avoid conflicts
-					tbb::make_filter<int, void>(executeMopde,
-						TBBFragmentFilter(PIPELINE_BATCH_SIZE, drawCall, fragmentCache, framebufferMutex)));
+				m_shadingState, m_viewportMatrix, m_guardBand, m_frustumNearFar.x, m_frustumNearFar.y, m_backBuffer.get());
+			drawCall.m_subPixelBits = m_subPixelBits;
+			if (m_shadingState.m_trColorWriteMode == TRColorWriteMode::TR_COLOR_WRITE_DISABLE)
+			{
+				//No varyings needed by depth only rendering
+				drawCall.m_varyings = TRShadingPipeline::k_varyingsNone;
+			}
+
+			//Select the implementations specialized for the interpolant layout and the sampling number
+			const DrawcallFuncs funcs = getDrawcallFuncs(drawCall.m_varyings, m_backBuffer->getSamplingNum());
+
+			//Vertex shader stage for the shared vertices
+			//Note: worthwhile only if the vertices are referenced by faces once at least on average
+			if (submesh.getIndices().size() >= submesh.getVertices().size())
+			{
+				processVertices(drawCall, m_shadedVertices);
+				drawCall.m_shadedVertices = m_shadedVertices.data();
+			}
+
+			if (pass == TR_PASS_VISIBILITY)
+			{
+				const int drawId = m_visibilityBuffer.m_numDraws++;
+				for (int f = 0; f < faceNum; f += BINNING_BATCH_SIZE)
+				{
+					funcs.m_renderFacesVisibility(drawCall, f, glm::min(f + BINNING_BATCH_SIZE, faceNum), drawId,
+						m_tileBinningCache, m_visibilityBuffer);
+				}
+			}
+			else if (pass == TR_PASS_MATERIAL)
+			{
+				const int drawId = m_visibilityBuffer.m_numDraws++;
+				funcs.m_shadeVisibilityBuffer(drawCall, drawId, m_tileBinningCache, m_visibilityBuffer);
+			}
+			//Sort-middle tile binning
+			else if (m_renderingMode != TRRenderingMode::TR_RENDERING_PIPELINE)
+			{
+				for (int f = 0; f < faceNum; f += BINNING_BATCH_SIZE)
+				{
+					funcs.m_renderFacesTileBinning(drawCall, f, glm::min(f + BINNING_BATCH_SIZE, faceNum), m_tileBinningCache);
+				}
+			}
+			else
+			{
+				for (int f = 0; f < faceNum; f += PIPELINE_BATCH_SIZE)
+				{
+					funcs.m_renderFacesPipeline(drawCall, f, glm::min(f + PIPELINE_BATCH_SIZE, faceNum), m_numTokens,
+						executeMopde, m_fragmentCache, m_framebufferMutex);
+				}
 			}
 
+			//Tighten the hierarchical depth for the following draw calls
+			if (m_shadingState.m_trDepthWriteMode == TRDepthWriteMode::TR_DEPTH_WRITE_ENABLE)
+			{
+				m_backBuffer->refreshHiZ();
+			}
 		}
 
 		return num_triangles;
@@ -469,157 +1096,167 @@ namespace TinyRenderer
 
 	unsigned char* TRRenderer::commitRenderedColorBuffer()
 	{
-		const auto &pixelBuffer = m_frontBuffer->getColorBuffer();
+		const auto &pixelBuffer = m_frontBuffer->getResolvedBuffer();
 		parallelFor((size_t)0, (size_t)(m_frontBuffer->getWidth() * m_frontBuffer->getHeight()), [&](const size_t &index)
 		{
 			const auto &pixel = pixelBuffer[index];
-			m_renderedImg[index * 3 + 0] = pixel[0][0];
-			m_renderedImg[index * 3 + 1] = pixel[0][1];
-			m_renderedImg[index * 3 + 2] = pixel[0][2];
+			m_renderedImg[index * 3 + 0] = pixel[0];
+			m_renderedImg[index * 3 + 1] = pixel[1];
+			m_renderedImg[index * 3 + 2] = pixel[2];
 		});
 		return m_renderedImg.data();
 	}
 
-	std::vector<TRShadingPipeline::VertexData> TRRenderer::clipingSutherlandHodgeman(
+	constexpr int TRRenderer::k_maxClippedVertices;
+	constexpr int TRRenderer::k_guardBandExtent;
+
+	//Signed distance to the clipping plane, inside <=> distance >= 0
+	static inline float distanceToClipingPlane(const glm::vec4 &p, const int &plane, const glm::vec2 &guardBand)
+	{
+		constexpr float wClippingPlane = 1e-5;
+		if (plane == 6)
+			return p.w - wClippingPlane;
+		//Note: side * p[axis] <= extent * p.w
+		const int axis = plane >> 1;
+		const float w = axis < 2 ? guardBand[axis] * p.w : p.w;
+		return (plane & 1) ? (w + p[axis]) : (w - p[axis]);
+	}
+
+	template<unsigned int Varyings>
+	int TRRenderer::clipingSutherlandHodgeman(
 		const TRShadingPipeline::VertexData &v0,
 		const TRShadingPipeline::VertexData &v1,
 		const TRShadingPipeline::VertexData &v2,
 		const float &near,
-		const float &far)
+		const float &far,
+		const glm::vec2 &guardBand,
+		TRShadingPipeline::VertexData *clipped)
 	{
 		//Clipping in the homogeneous clipping space
 		//Refs:
 		//https://fabiensanglard.net/polygon_codec/clippingdocument/Clipping.pdf
 		//https://fabiensanglard.net/polygon_codec/
 
+		//Outcodes of vertices: bit 0~6 -> outside of the clipping plane 0~6, bit 7 -> w < near, bit 8 -> w > far,
+		//                      bit 9~12 -> outside of the x/y planes of viewport (only for trivial rejection)
+		const unsigned int viewportMask = 0xfu << 9;
+		auto computeOutcode = [&](const glm::vec4 &p) -> unsigned int
+		{
+			unsigned int code = 0;
+			for (int plane = 0; plane < 7; ++plane)
+			{
+				code |= (distanceToClipingPlane(p, plane, guardBand) < 0) ? (1u << plane) : 0u;
+			}
+			code |= (p.w < near) ? (1u << 7) : 0u;
+			code |= (p.w > far) ? (1u << 8) : 0u;
+			code |= (p.x > p.w) ? (1u << 9) : 0u;
+			code |= (p.x < -p.w) ? (1u << 10) : 0u;
+			code |= (p.y > p.w) ? (1u << 11) : 0u;
+			code |= (p.y < -p.w) ? (1u << 12) : 0u;
+			return code;
+		};
+		const unsigned int outcode0 = computeOutcode(v0.m_cpos);
+		const unsigned int outcode1 = computeOutcode(v1.m_cpos);
+		const unsigned int outcode2 = computeOutcode(v2.m_cpos);
+
 		//Optimization: complete outside or complete inside
 		//Note: in the following situation, we could return the answer without complicate cliping,
 		//      and this optimization should be very important.
+		if (((outcode0 | outcode1 | outcode2) & ~viewportMask) == 0)
 		{
-			auto isPointInsideInClipingFrustum = [](const glm::vec4 &p, const float &near, const float &far) -> bool
-			{
-				return (p.x <= p.w && p.x >= -p.w) && (p.y <= p.w && p.y >= -p.w)
-					&& (p.z <= p.w && p.z >= -p.w) && (p.w <= far && p.w >= near);
-			};
-
 			//Totally inside
-			if (isPointInsideInClipingFrustum(v0.m_cpos, near, far) &&
-				isPointInsideInClipingFrustum(v1.m_cpos, near, far) &&
-				isPointInsideInClipingFrustum(v2.m_cpos, near, far))
-			{
-				return { v0,v1,v2 };
-			}
-
-			//Totally outside
-			if (v0.m_cpos.w < near && v1.m_cpos.w < near && v2.m_cpos.w < near)
-				return{};
-			if (v0.m_cpos.w > far && v1.m_cpos.w > far && v2.m_cpos.w > far)
-				return{};
-			if (v0.m_cpos.x > v0.m_cpos.w && v1.m_cpos.x > v1.m_cpos.w && v2.m_cpos.x > v2.m_cpos.w)
-				return{};
-			if (v0.m_cpos.x < -v0.m_cpos.w && v1.m_cpos.x < -v1.m_cpos.w && v2.m_cpos.x < -v2.m_cpos.w)
-				return{};
-			if (v0.m_cpos.y > v0.m_cpos.w && v1.m_cpos.y > v1.m_cpos.w && v2.m_cpos.y > v2.m_cpos.w)
-				return{};
-			if (v0.m_cpos.y < -v0.m_cpos.w && v1.m_cpos.y < -v1.m_cpos.w && v2.m_cpos.y < -v2.m_cpos.w)
-				return{};
-			if (v0.m_cpos.z > v0.m_cpos.w && v1.m_cpos.z > v1.m_cpos.w && v2.m_cpos.z > v2.m_cpos.w)
-				return{};
-			if (v0.m_cpos.z < -v0.m_cpos.w && v1.m_cpos.z < -v1.m_cpos.w && v2.m_cpos.z < -v2.m_cpos.w)
-				return{};
+			clipped[0] = v0;
+			clipped[1] = v1;
+			clipped[2] = v2;
+			return 3;
 		}
-
-		std::vector<TRShadingPipeline::VertexData> insideVertices;
-		std::vector<TRShadingPipeline::VertexData> tmp = { v0, v1, v2 };
-		enum Axis { X = 0, Y = 1, Z = 2 };
-
-		//w=x plane & w=-x plane
+		if ((outcode0 & outcode1 & outcode2) != 0)
 		{
-			insideVertices = clipingSutherlandHodgemanAux(tmp, Axis::X, +1);
-			tmp = insideVertices;
-
-			insideVertices = clipingSutherlandHodgemanAux(tmp, Axis::X, -1);
-			tmp = insideVertices;
+			//Totally outside of one of the planes (or the viewport)
+			return 0;
 		}
 
-		//w=y plane & w=-y plane
+		//Only the planes crossed by the triangle need clipping
+		const unsigned int clipMask = (outcode0 | outcode1 | outcode2) & 0x7f;
+		int numPlanes = 0;
+		for (int plane = 0; plane < 7; ++plane)
 		{
-			insideVertices = clipingSutherlandHodgemanAux(tmp, Axis::Y, +1);
-			tmp = insideVertices;
-
-			insideVertices = clipingSutherlandHodgemanAux(tmp, Axis::Y, -1);
-			tmp = insideVertices;
+			numPlanes += (clipMask >> plane) & 1;
 		}
 
-		//w=z plane & w=-z plane
+		//Ping-pong between the two fixed-capacity buffers, arranged to end up in clipped
+		TRShadingPipeline::VertexData scratch[k_maxClippedVertices];
+		TRShadingPipeline::VertexData *src = (numPlanes & 1) ? scratch : clipped;
+		TRShadingPipeline::VertexData *dst = (numPlanes & 1) ? clipped : scratch;
+		src[0] = v0;
+		src[1] = v1;
+		src[2] = v2;
+		int numVerts = 3;
+		for (int plane = 0; plane < 7 && numVerts > 0; ++plane)
 		{
-			insideVertices = clipingSutherlandHodgemanAux(tmp, Axis::Z, +1);
-			tmp = insideVertices;
-
-			insideVertices = clipingSutherlandHodgemanAux(tmp, Axis::Z, -1);
-			tmp = insideVertices;
+			if ((clipMask & (1u << plane)) == 0)
+				continue;
+			numVerts = clipingSutherlandHodgemanAux<Varyings>(src, numVerts, plane, guardBand, dst);
+			std::swap(src, dst);
 		}
 
-		//w=1e-5 plane
+		//Note: totally clipped away in the middle
+		if (src != clipped)
 		{
-			insideVertices = {};
-			int numVerts = tmp.size();
-			constexpr float wClippingPlane = 1e-5;
-			for (int i = 0; i < numVerts; ++i)
-			{
-				const auto &begVert = tmp[(i - 1 + numVerts) % numVerts];
-				const auto &endVert = tmp[i];
-				float begIsInside = (begVert.m_cpos.w < wClippingPlane) ? -1 : 1;
-				float endIsInside = (endVert.m_cpos.w < wClippingPlane) ? -1 : 1;
-				//One of them is outside
-				if (begIsInside * endIsInside < 0)
-				{
-					// t = (w_clipping_plane-w1)/((w1-w2)
-					float t = (wClippingPlane - begVert.m_cpos.w) / (begVert.m_cpos.w - endVert.m_cpos.w);
-					auto intersectedVert = TRShadingPipeline::VertexData::lerp(begVert, endVert, t);
-					insideVertices.push_back(intersectedVert);
-				}
-				//If current vertices is inside
-				if (endIsInside > 0)
-				{
-					insideVertices.push_back(endVert);
-				}
-			}
+			return 0;
 		}
-
-		return insideVertices;
+		return numVerts;
 	}
 
-	std::vector<TRShadingPipeline::VertexData> TRRenderer::clipingSutherlandHodgemanAux(
-		const std::vector<TRShadingPipeline::VertexData> &polygon,
-		const int &axis,
-		const int &side)
+	template<unsigned int Varyings>
+	int TRRenderer::clipingSutherlandHodgemanAux(
+		const TRShadingPipeline::VertexData *polygon,
+		const int &numVerts,
+		const int &plane,
+		const glm::vec2 &guardBand,
+		TRShadingPipeline::VertexData *insidePolygon)
 	{
-		std::vector<TRShadingPipeline::VertexData> insidePolygon;
+		//Note: the distance of each vertex is evaluated once
+		float distance[k_maxClippedVertices];
+		for (int i = 0; i < numVerts; ++i)
+		{
+			distance[i] = distanceToClipingPlane(polygon[i].m_cpos, plane, guardBand);
+		}
 
-		int numVerts = polygon.size();
+		int numInside = 0;
 		for (int i = 0; i < numVerts; ++i)
 		{
-			const auto &begVert = polygon[(i - 1 + numVerts) % numVerts];
-			const auto &endVert = polygon[i];
-			char begIsInside = ((side * (begVert.m_cpos[axis]) <= begVert.m_cpos.w) ? 1 : -1);
-			char endIsInside = ((side * (endVert.m_cpos[axis]) <= endVert.m_cpos.w) ? 1 : -1);
+			const int beg = (i - 1 + numVerts) % numVerts;
+			const bool begIsInside = distance[beg] >= 0;
+			const bool endIsInside = distance[i] >= 0;
 			//One of them is outside
-			if (begIsInside * endIsInside < 0)
+			if (begIsInside != endIsInside)
 			{
-				// t = (w1 - y1)/((w1-y1)-(w2-y2))
-				float t = (begVert.m_cpos.w - side * begVert.m_cpos[axis])
-					/ ((begVert.m_cpos.w - side * begVert.m_cpos[axis]) - (endVert.m_cpos.w - side * endVert.m_cpos[axis]));
-				auto intersectedVert = TRShadingPipeline::VertexData::lerp(begVert, endVert, t);
-				insidePolygon.push_back(intersectedVert);
+				// t = d1/(d1-d2)
+				float t = distance[beg] / (distance[beg] - distance[i]);
+				insidePolygon[numInside++] = TRShadingPipeline::VertexData::lerp<Varyings>(polygon[beg], polygon[i], t);
 			}
 			//If current vertices is inside
-			if (endIsInside > 0)
+			if (endIsInside)
 			{
-				insidePolygon.push_back(endVert);
+				insidePolygon[numInside++] = polygon[i];
 			}
 		}
-		return insidePolygon;
+		return numInside;
 	}
 
+	//Instantiation of the precompiled interpolant layouts
+	template int TRRenderer::clipingSutherlandHodgeman<TRShadingPipeline::k_varyingsNone>(
+		const TRShadingPipeline::VertexData &, const TRShadingPipeline::VertexData &, const TRShadingPipeline::VertexData &,
+		const float &, const float &, const glm::vec2 &, TRShadingPipeline::VertexData *);
+	template int TRRenderer::clipingSutherlandHodgeman<TRShadingPipeline::k_varyingsTexcoord>(
+		const TRShadingPipeline::VertexData &, const TRShadingPipeline::VertexData &, const TRShadingPipeline::VertexData &,
+		const float &, const float &, const glm::vec2 &, TRShadingPipeline::VertexData *);
+	template int TRRenderer::clipingSutherlandHodgeman<TRShadingPipeline::k_varyingsLighting>(
+		const TRShadingPipeline::VertexData &, const TRShadingPipeline::VertexData &, const TRShadingPipeline::VertexData &,
+		const float &, const float &, const glm::vec2 &, TRShadingPipeline::VertexData *);
+	template int TRRenderer::clipingSutherlandHodgeman<TRShadingPipeline::k_varyingsAll>(
+		const TRShadingPipeline::VertexData &, const TRShadingPipeline::VertexData &, const TRShadingPipeline::VertexData &,
+		const float &, const float &, const glm::vec2 &, TRShadingPipeline::VertexData *);
+
 }
@@ -24,7 +24,7 @@ namespace TinyRenderer
 		return m_scene.m_lights[name];
 	}
 
-	void TRSceneParser::parse(const std::string &path, TRRenderer::ptr renderer, bool generatedMipmap)
+	void TRSceneParser::parse(const std::string &path, TRRenderer::ptr renderer, bool generatedMipmap, bool compressedTexture)
 	{
 		std::ifstream sceneFile;
 		sceneFile.open(path, std::ios::in);
@@ -207,7 +207,7 @@ namespace TinyRenderer
 
 				std::getline(sceneFile, line);
 				std::string path = parseStr(line);
-				TRDrawableMesh::ptr drawable = std::make_shared<TRDrawableMesh>(path, generatedMipmap);
+				TRDrawableMesh::ptr drawable = std::make_shared<TRDrawableMesh>(path, generatedMipmap, compressedTexture);
 				renderer->addDrawableMesh(drawable);
 				m_scene.m_entities[name] = drawable;
 
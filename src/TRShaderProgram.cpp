@@ -36,6 +36,13 @@ namespace TinyRenderer
 
 	//----------------------------------------------TRTextureShadingPipeline----------------------------------------------
 
+	void TRTextureShadingPipeline::vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+		const unsigned int &varyings) const
+	{
+		//Same as TR3DShadingPipeline::vertexShader(), no tangent frame
+		transformVerticesBatch(in, n, out, varyings & ~TR_VARYING_TBN);
+	}
+
 	void TRTextureShadingPipeline::fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 		const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const
 	{
@@ -48,8 +55,28 @@ namespace TinyRenderer
 		}
 	}
 
+	void TRTextureShadingPipeline::fragmentShaderQuad(const FragmentData *data, const unsigned int &/*mask*/, glm::vec4 *fragColor,
+		const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const
+	{
+		//Default color
+		if (m_diffuseTexId == -1)
+		{
+			fragColor[0] = fragColor[1] = fragColor[2] = fragColor[3] = glm::vec4(m_kE, 1.0f);
+			return;
+		}
+
+		texture2DQuad(m_diffuseTexId, data, dUVdx, dUVdy, fragColor);
+	}
+
 	//----------------------------------------------TRLODVisualizePipeline----------------------------------------------
 
+	void TRLODVisualizePipeline::vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+		const unsigned int &varyings) const
+	{
+		//Same as TR3DShadingPipeline::vertexShader(), no tangent frame
+		transformVerticesBatch(in, n, out, varyings & ~TR_VARYING_TBN);
+	}
+
 	void TRLODVisualizePipeline::fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 		const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const
 	{
@@ -86,6 +113,13 @@ namespace TinyRenderer
 
 	//----------------------------------------------TRPhongShadingPipeline----------------------------------------------
 
+	void TRPhongShadingPipeline::vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+		const unsigned int &varyings) const
+	{
+		//Same as TR3DShadingPipeline::vertexShader(), no tangent frame
+		transformVerticesBatch(in, n, out, varyings & ~TR_VARYING_TBN);
+	}
+
 	void TRPhongShadingPipeline::fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 		const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const
 	{
@@ -151,17 +185,47 @@ namespace TinyRenderer
 
 	//----------------------------------------------TRBlinPhongShadingPipeline----------------------------------------------
 
+	void TRBlinnPhongShadingPipeline::vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+		const unsigned int &varyings) const
+	{
+		//Same as TR3DShadingPipeline::vertexShader(), no tangent frame
+		transformVerticesBatch(in, n, out, varyings & ~TR_VARYING_TBN);
+	}
+
 	void TRBlinnPhongShadingPipeline::fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 		const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const
 	{
-		fragColor = glm::vec4(0.0f);
-
 		//Fetch the corresponding color 
-		glm::vec3 ambColor, difColor, speColor, glowColor;
 		glm::vec4 difftexcolor = (m_diffuseTexId != -1) ? texture2D(m_diffuseTexId, data.m_tex, dUVdx, dUVdy) : glm::vec4(1.0f);
+		glm::vec3 speColor = (m_specularTexId != -1) ? glm::vec3(texture2D(m_specularTexId, data.m_tex, dUVdx, dUVdy)) : m_kS;
+		glm::vec3 glowColor = (m_glowTexId != -1) ? glm::vec3(texture2D(m_glowTexId, data.m_tex, dUVdx, dUVdy)) : m_kE;
+		lighting(data, difftexcolor, speColor, glowColor, fragColor);
+	}
+
+	void TRBlinnPhongShadingPipeline::fragmentShaderQuad(const FragmentData *data, const unsigned int &mask, glm::vec4 *fragColor,
+		const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const
+	{
+		//Fetch the corresponding colors of the 2x2 fragments block
+		glm::vec4 difftexcolor[4], speTexel[4], glowTexel[4];
+		if (m_diffuseTexId != -1) texture2DQuad(m_diffuseTexId, data, dUVdx, dUVdy, difftexcolor);
+		if (m_specularTexId != -1) texture2DQuad(m_specularTexId, data, dUVdx, dUVdy, speTexel);
+		if (m_glowTexId != -1) texture2DQuad(m_glowTexId, data, dUVdx, dUVdy, glowTexel);
+		for (int f = 0; f < 4; ++f)
+		{
+			if ((mask & (1u << f)) == 0)
+				continue;
+			lighting(data[f], (m_diffuseTexId != -1) ? difftexcolor[f] : glm::vec4(1.0f),
+				(m_specularTexId != -1) ? glm::vec3(speTexel[f]) : m_kS,
+				(m_glowTexId != -1) ? glm::vec3(glowTexel[f]) : m_kE, fragColor[f]);
+		}
+	}
+
+	void TRBlinnPhongShadingPipeline::lighting(const FragmentData &data, const glm::vec4 &difftexcolor, 
+		const glm::vec3 &speColor, const glm::vec3 &glowColor, glm::vec4 &fragColor) const
+	{
+		fragColor = glm::vec4(0.0f);
+		glm::vec3 ambColor, difColor;
 		ambColor = difColor = (m_diffuseTexId != -1) ? glm::vec3(difftexcolor) : m_kD;
-		speColor = (m_specularTexId != -1) ? glm::vec3(texture2D(m_specularTexId, data.m_tex, dUVdx, dUVdy)) : m_kS;
-		glowColor = (m_glowTexId != -1) ? glm::vec3(texture2D(m_glowTexId, data.m_tex, dUVdx, dUVdy)) : m_kE;
 
 		//No lighting
 		if (!m_lightingEnable)
@@ -226,20 +290,55 @@ namespace TinyRenderer
 		glm::vec3 T = glm::normalize(m_invTransModelMatrix * vertex.m_tbn[0]);
 		glm::vec3 B = glm::normalize(m_invTransModelMatrix * vertex.m_tbn[1]);
 		vertex.m_tbn = glm::mat3(T, B, vertex.m_nor);
-		vertex.m_needInterpolatedTBN = true;
+	}
+
+	void TRBlinnPhongNormalMapShadingPipeline::vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+		const unsigned int &varyings) const
+	{
+		transformVerticesBatch(in, n, out, varyings);
 	}
 
 	void TRBlinnPhongNormalMapShadingPipeline::fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 		const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const
 	{
-		fragColor = glm::vec4(0.0f);
-
 		//Fetch the corresponding color 
-		glm::vec3 ambColor, difColor, speColor, glowColor;
 		glm::vec4 difftexcolor = (m_diffuseTexId != -1) ? texture2D(m_diffuseTexId, data.m_tex, dUVdx, dUVdy) : glm::vec4(1.0f);
+		glm::vec3 speColor = (m_specularTexId != -1) ? glm::vec3(texture2D(m_specularTexId, data.m_tex, dUVdx, dUVdy)) : m_kS;
+		glm::vec3 glowColor = (m_glowTexId != -1) ? glm::vec3(texture2D(m_glowTexId, data.m_tex, dUVdx, dUVdy)) : m_kE;
+		glm::vec4 normalTexel;
+		if (m_lightingEnable && m_normalTexId != -1)
+		{
+			normalTexel = texture2D(m_normalTexId, data.m_tex, dUVdx, dUVdy);
+		}
+		lighting(data, difftexcolor, speColor, glowColor, (m_normalTexId != -1) ? &normalTexel : nullptr, fragColor);
+	}
+
+	void TRBlinnPhongNormalMapShadingPipeline::fragmentShaderQuad(const FragmentData *data, const unsigned int &mask, 
+		glm::vec4 *fragColor, const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const
+	{
+		//Fetch the corresponding colors of the 2x2 fragments block
+		glm::vec4 difftexcolor[4], speTexel[4], glowTexel[4], normalTexel[4];
+		if (m_diffuseTexId != -1) texture2DQuad(m_diffuseTexId, data, dUVdx, dUVdy, difftexcolor);
+		if (m_specularTexId != -1) texture2DQuad(m_specularTexId, data, dUVdx, dUVdy, speTexel);
+		if (m_glowTexId != -1) texture2DQuad(m_glowTexId, data, dUVdx, dUVdy, glowTexel);
+		if (m_lightingEnable && m_normalTexId != -1) texture2DQuad(m_normalTexId, data, dUVdx, dUVdy, normalTexel);
+		for (int f = 0; f < 4; ++f)
+		{
+			if ((mask & (1u << f)) == 0)
+				continue;
+			lighting(data[f], (m_diffuseTexId != -1) ? difftexcolor[f] : glm::vec4(1.0f),
+				(m_specularTexId != -1) ? glm::vec3(speTexel[f]) : m_kS,
+				(m_glowTexId != -1) ? glm::vec3(glowTexel[f]) : m_kE,
+				(m_normalTexId != -1) ? &normalTexel[f] : nullptr, fragColor[f]);
+		}
+	}
+
+	void TRBlinnPhongNormalMapShadingPipeline::lighting(const FragmentData &data, const glm::vec4 &difftexcolor,
+		const glm::vec3 &speColor, const glm::vec3 &glowColor, const glm::vec4 *normalTexel, glm::vec4 &fragColor) const
+	{
+		fragColor = glm::vec4(0.0f);
+		glm::vec3 ambColor, difColor;
 		ambColor = difColor = (m_diffuseTexId != -1) ? glm::vec3(difftexcolor) : m_kD;
-		speColor = (m_specularTexId != -1) ? glm::vec3(texture2D(m_specularTexId, data.m_tex, dUVdx, dUVdy)) : m_kS;
-		glowColor = (m_glowTexId != -1) ? glm::vec3(texture2D(m_glowTexId, data.m_tex, dUVdx, dUVdy)) : m_kE;
 
 		//No lighting
 		if (!m_lightingEnable)
@@ -250,9 +349,9 @@ namespace TinyRenderer
 
 		//Normal
 		glm::vec3 normal = data.m_nor;
-		if (m_normalTexId != -1)
+		if (normalTexel != nullptr)
 		{
-			normal = glm::vec3(texture2D(m_normalTexId, data.m_tex, dUVdx, dUVdy)) * 2.0f - glm::vec3(1.0f);
+			normal = glm::vec3(*normalTexel) * 2.0f - glm::vec3(1.0f);
 			normal = data.m_tbn * normal;
 		}
 		normal = glm::normalize(normal);
@@ -301,6 +400,13 @@ namespace TinyRenderer
 
 	//----------------------------------------------TRAlphaBlendingShadingPipeline----------------------------------------------
 
+	void TRAlphaBlendingShadingPipeline::vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+		const unsigned int &varyings) const
+	{
+		//Same as TR3DShadingPipeline::vertexShader(), no tangent frame
+		transformVerticesBatch(in, n, out, varyings & ~TR_VARYING_TBN);
+	}
+
 	void TRAlphaBlendingShadingPipeline::fragmentShader(const FragmentData &data, glm::vec4 &fragColor,
 		const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const
 	{
@@ -314,4 +420,23 @@ namespace TinyRenderer
 
 		fragColor.a *= m_transparency;
 	}
+
+	void TRAlphaBlendingShadingPipeline::fragmentShaderQuad(const FragmentData *data, const unsigned int &/*mask*/, glm::vec4 *fragColor,
+		const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const
+	{
+		//Default color
+		if (m_diffuseTexId == -1)
+		{
+			fragColor[0] = fragColor[1] = fragColor[2] = fragColor[3] = glm::vec4(m_kE, 1.0f);
+		}
+		else
+		{
+			texture2DQuad(m_diffuseTexId, data, dUVdx, dUVdy, fragColor);
+		}
+
+		for (int f = 0; f < 4; ++f)
+		{
+			fragColor[f].a *= m_transparency;
+		}
+	}
 }
\ No newline at end of file
@@ -4,11 +4,16 @@
 #include <iostream>
 
 #include "TRParallelWrapper.h"
+#include "TRRasterizer.h"
+#include "TRFrameBuffer.h"
+#include "TRDrawableMesh.h"
+#include "TRSIMD.h"
 
 namespace TinyRenderer
 {
 	//----------------------------------------------VertexData----------------------------------------------
 
+	template<unsigned int Varyings>
 	TRShadingPipeline::VertexData TRShadingPipeline::VertexData::lerp(
 		const TRShadingPipeline::VertexData &v0,
 		const TRShadingPipeline::VertexData &v1,
@@ -16,40 +21,18 @@ namespace TinyRenderer
 	{
 		//Linear interpolation
 		VertexData result;
-		result.m_pos = (1.0f - frac) * v0.m_pos + frac * v1.m_pos;
-		result.m_nor = (1.0f - frac) * v0.m_nor + frac * v1.m_nor;
-		result.m_tex = (1.0f - frac) * v0.m_tex + frac * v1.m_tex;
 		result.m_cpos = (1.0f - frac) * v0.m_cpos + frac * v1.m_cpos;
 		result.m_spos.x = (1.0f - frac) * v0.m_spos.x + frac * v1.m_spos.x;
 		result.m_spos.y = (1.0f - frac) * v0.m_spos.y + frac * v1.m_spos.y;
 		result.m_rhw = (1.0f - frac) * v0.m_rhw + frac * v1.m_rhw;
-		if (v0.m_needInterpolatedTBN)
-		{
+		if (Varyings & TR_VARYING_POSITION)
+			result.m_pos = (1.0f - frac) * v0.m_pos + frac * v1.m_pos;
+		if (Varyings & TR_VARYING_NORMAL)
+			result.m_nor = (1.0f - frac) * v0.m_nor + frac * v1.m_nor;
+		if (Varyings & TR_VARYING_TEXCOORD)
+			result.m_tex = (1.0f - frac) * v0.m_tex + frac * v1.m_tex;
+		if (Varyings & TR_VARYING_TBN)
 			result.m_tbn = (1.0f - frac) * v0.m_tbn + frac * v1.m_tbn;
-			result.m_needInterpolatedTBN = true;
-		}
-
-		return result;
-	}
-
-	TRShadingPipeline::FragmentData TRShadingPipeline::VertexData::barycentricLerp(
-		const VertexData &v0, 
-		const VertexData &v1, 
-		const VertexData &v2,
-		const glm::vec3 &w)
-	{
-		FragmentData result;
-		result.m_pos = w.x * v0.m_pos + w.y * v1.m_pos + w.z * v2.m_pos;
-		result.m_nor = w.x * v0.m_nor + w.y * v1.m_nor + w.z * v2.m_nor;
-		result.m_tex = w.x * v0.m_tex + w.y * v1.m_tex + w.z * v2.m_tex;
-		result.m_rhw = w.x * v0.m_rhw + w.y * v1.m_rhw + w.z * v2.m_rhw;
-		result.m_spos.x = w.x * v0.m_spos.x + w.y * v1.m_spos.x + w.z * v2.m_spos.x;
-		result.m_spos.y = w.x * v0.m_spos.y + w.y * v1.m_spos.y + w.z * v2.m_spos.y;
-
-		if (v0.m_needInterpolatedTBN)
-		{
-			result.m_tbn = w.x * v0.m_tbn + w.y * v1.m_tbn + w.z * v2.m_tbn;
-		}
 
 		return result;
 	}
@@ -59,40 +42,158 @@ namespace TinyRenderer
 		return w.x * d0 + w.y * d1 + w.z * d2;
 	}
 
+	template<unsigned int Varyings>
 	void TRShadingPipeline::VertexData::prePerspCorrection(VertexData &v)
 	{
 		//Perspective correction: the world space properties should be multipy by 1/w before rasterization
 		//https://zhuanlan.zhihu.com/p/144331875
 		v.m_rhw = 1.0f / v.m_cpos.w;
-		v.m_pos *= v.m_rhw;
-		v.m_tex *= v.m_rhw;
-		v.m_nor *= v.m_rhw;
+		if (Varyings & TR_VARYING_POSITION)
+			v.m_pos *= v.m_rhw;
+		if (Varyings & TR_VARYING_TEXCOORD)
+			v.m_tex *= v.m_rhw;
+		if (Varyings & TR_VARYING_NORMAL)
+			v.m_nor *= v.m_rhw;
+	}
+
+	//----------------------------------------------QuadFragmentStream----------------------------------------------
+
+	void TRShadingPipeline::QuadFragmentStream::reserve(const size_t &numQuads)
+	{
+		m_quadPos.reserve(numQuads);
+		m_coverage.reserve(numQuads);
+		m_coverageDepth.reserve(numQuads * 4 * m_samplingNum);
+		if (m_varyings & TR_VARYING_POSITION) m_pos.reserve(numQuads * 4);
+		if (m_varyings & TR_VARYING_NORMAL) m_nor.reserve(numQuads * 4);
+		if (m_varyings & TR_VARYING_TEXCOORD) m_tex.reserve(numQuads * 4);
+		if (m_varyings & TR_VARYING_TBN) m_tbn.reserve(numQuads * 4);
+	}
+
+	void TRShadingPipeline::QuadFragmentStream::clear()
+	{
+		//Note: keep the capacity for reusing
+		m_quadPos.clear();
+		m_coverage.clear();
+		m_coverageDepth.clear();
+		m_pos.clear();
+		m_nor.clear();
+		m_tex.clear();
+		m_tbn.clear();
+	}
+
+	size_t TRShadingPipeline::QuadFragmentStream::appendQuad(const glm::ivec2 &pos, const unsigned int &coverage,
+		const float *coverageDepth)
+	{
+		const size_t index = m_quadPos.size() * 4;
+		m_quadPos.push_back(pos);
+		m_coverage.push_back(coverage);
+		m_coverageDepth.insert(m_coverageDepth.end(), coverageDepth, coverageDepth + 4 * m_samplingNum);
+		if (m_varyings & TR_VARYING_POSITION) m_pos.resize(index + 4);
+		if (m_varyings & TR_VARYING_NORMAL) m_nor.resize(index + 4);
+		if (m_varyings & TR_VARYING_TEXCOORD) m_tex.resize(index + 4);
+		if (m_varyings & TR_VARYING_TBN) m_tbn.resize(index + 4);
+		return index;
 	}
 
-	void TRShadingPipeline::FragmentData::aftPrespCorrection(FragmentData &v)
+	template<unsigned int Varyings>
+	void TRShadingPipeline::QuadFragmentStream::interpolate(const size_t &index, const VertexData &v0, 
+		const VertexData &v1, const VertexData &v2, const glm::vec3 &w)
 	{
 		//Perspective correction: the world space properties should be multipy by w after rasterization
 		//https://zhuanlan.zhihu.com/p/144331875
-		float w = 1.0f / v.m_rhw;
-		v.m_pos *= w;
-		v.m_tex *= w;
-		v.m_nor *= w;
+		const float rhw = w.x * v0.m_rhw + w.y * v1.m_rhw + w.z * v2.m_rhw;
+		const float invRhw = 1.0f / rhw;
+		if (Varyings & TR_VARYING_POSITION)
+		{
+			m_pos[index] = w.x * v0.m_pos + w.y * v1.m_pos + w.z * v2.m_pos;
+			m_pos[index] *= invRhw;
+		}
+		if (Varyings & TR_VARYING_NORMAL)
+		{
+			m_nor[index] = w.x * v0.m_nor + w.y * v1.m_nor + w.z * v2.m_nor;
+			m_nor[index] *= invRhw;
+		}
+		if (Varyings & TR_VARYING_TEXCOORD)
+		{
+			m_tex[index] = w.x * v0.m_tex + w.y * v1.m_tex + w.z * v2.m_tex;
+			m_tex[index] *= invRhw;
+		}
+		if (Varyings & TR_VARYING_TBN)
+		{
+			m_tbn[index] = w.x * v0.m_tbn + w.y * v1.m_tbn + w.z * v2.m_tbn;
+		}
+	}
+
+	void TRShadingPipeline::QuadFragmentStream::fetchFragment(const size_t &q, const int &f, FragmentData &data) const
+	{
+		const size_t index = q * 4 + f;
+		data.m_spos = m_quadPos[q] + glm::ivec2(f & 1, f >> 1);
+		if (m_varyings & TR_VARYING_POSITION) data.m_pos = m_pos[index];
+		if (m_varyings & TR_VARYING_NORMAL) data.m_nor = m_nor[index];
+		if (m_varyings & TR_VARYING_TEXCOORD) data.m_tex = m_tex[index];
+		if (m_varyings & TR_VARYING_TBN) data.m_tbn = m_tbn[index];
+	}
+
+	glm::vec2 TRShadingPipeline::QuadFragmentStream::dUVdx(const size_t &q) const
+	{
+		if (!(m_varyings & TR_VARYING_TEXCOORD))
+			return glm::vec2(0.0f);
+		return m_tex[q * 4 + 1] - m_tex[q * 4 + 0];
+	}
+
+	glm::vec2 TRShadingPipeline::QuadFragmentStream::dUVdy(const size_t &q) const
+	{
+		if (!(m_varyings & TR_VARYING_TEXCOORD))
+			return glm::vec2(0.0f);
+		return m_tex[q * 4 + 2] - m_tex[q * 4 + 0];
 	}
 
 	//----------------------------------------------TRShadingPipeline----------------------------------------------
 
-	std::vector<TRTexture2D::ptr> TRShadingPipeline::m_globalTextureUnits = {};
-	std::vector<TRLight::ptr> TRShadingPipeline::m_lights = {};
-	glm::vec3 TRShadingPipeline::m_viewerPos = glm::vec3(0.0f);
-	float TRShadingPipeline::m_exposure = 1.0f;
+	tbb::concurrent_vector<TRTexture2D::ptr> TRShadingPipeline::m_globalTextureUnits = {};
+
+	constexpr unsigned int TRShadingPipeline::k_varyingsNone;
+	constexpr unsigned int TRShadingPipeline::k_varyingsTexcoord;
+	constexpr unsigned int TRShadingPipeline::k_varyingsLighting;
+	constexpr unsigned int TRShadingPipeline::k_varyingsAll;
 
+	unsigned int TRShadingPipeline::getVaryingsLayout(const unsigned int &varyings)
+	{
+		//Round up to the smallest precompiled layout containing all of the declared varyings
+		if (varyings == k_varyingsNone)
+			return k_varyingsNone;
+		if ((varyings & ~k_varyingsTexcoord) == 0)
+			return k_varyingsTexcoord;
+		if ((varyings & ~k_varyingsLighting) == 0)
+			return k_varyingsLighting;
+		return k_varyingsAll;
+	}
+
+	template<unsigned int Varyings, int Samples>
 	void TRShadingPipeline::rasterizeFillEdgeFunction(
 		const VertexData &v0,
 		const VertexData &v1,
 		const VertexData &v2,
 		const unsigned int &screenWidth,
 		const unsigned int &screenHeight,
-		std::vector<QuadFragments> &rasterized_fragments)
+		QuadFragmentStream &rasterized_fragments,
+		const TRFrameBuffer *hizBuffer,
+		const TRDepthFunc &depthFunc)
+	{
+		rasterizeFillEdgeFunction<Varyings, Samples>(v0, v1, v2, glm::ivec2(0, 0),
+			glm::ivec2((int)screenWidth - 1, (int)screenHeight - 1), rasterized_fragments, hizBuffer, depthFunc);
+	}
+
+	template<unsigned int Varyings, int Samples>
+	void TRShadingPipeline::rasterizeFillEdgeFunction(
+		const VertexData &v0,
+		const VertexData &v1,
+		const VertexData &v2,
+		const glm::ivec2 &regionMin,
+		const glm::ivec2 &regionMax,
+		QuadFragmentStream &rasterized_fragments,
+		const TRFrameBuffer *hizBuffer,
+		const TRDepthFunc &depthFunc)
 	{
 		//Edge function rasterization algorithm
 		//Accelerated Half-Space Triangle Rasterization
@@ -100,19 +201,24 @@ namespace TinyRenderer
 		//     Acta Polytechnica Hungarica, 2015, 12(7): 217-236.
 		//	   http://acta.uni-obuda.hu/Mileff_Nehez_Dudra_63.pdf
 
+		//Note: the screen space positions are fixed-point with k_subPixelBits fractional bits
 		VertexData v[] = { v0, v1, v2 };
 		glm::ivec2 boundingMin;
 		glm::ivec2 boundingMax;
-		boundingMin.x = std::max(std::min(v0.m_spos.x, std::min(v1.m_spos.x, v2.m_spos.x)), 0);
-		boundingMin.y = std::max(std::min(v0.m_spos.y, std::min(v1.m_spos.y, v2.m_spos.y)), 0);
-		boundingMax.x = std::min(std::max(v0.m_spos.x, std::max(v1.m_spos.x, v2.m_spos.x)), (int)screenWidth - 1);
-		boundingMax.y = std::min(std::max(v0.m_spos.y, std::max(v1.m_spos.y, v2.m_spos.y)), (int)screenHeight - 1);
+		boundingMin.x = std::max(subPixelToPixelMin(std::min(v0.m_spos.x, std::min(v1.m_spos.x, v2.m_spos.x))), regionMin.x);
+		boundingMin.y = std::max(subPixelToPixelMin(std::min(v0.m_spos.y, std::min(v1.m_spos.y, v2.m_spos.y))), regionMin.y);
+		boundingMax.x = std::min(subPixelToPixelMax(std::max(v0.m_spos.x, std::max(v1.m_spos.x, v2.m_spos.x))), regionMax.x);
+		boundingMax.y = std::min(subPixelToPixelMax(std::max(v0.m_spos.y, std::max(v1.m_spos.y, v2.m_spos.y))), regionMax.y);
+
+		//Outside of the region
+		if (boundingMin.x > boundingMax.x || boundingMin.y > boundingMax.y)
+			return;
 
 		//Adjust the order
 		{
-			int orient = 0;
-			auto e1 = v1.m_spos - v0.m_spos;
-			auto e2 = v2.m_spos - v0.m_spos;
+			int64_t orient = 0;
+			const glm::i64vec2 e1 = glm::i64vec2(v1.m_spos - v0.m_spos);
+			const glm::i64vec2 e2 = glm::i64vec2(v2.m_spos - v0.m_spos);
 			orient = e1.x * e2.y - e1.y * e2.x;
 			if (orient > 0)
 			{
@@ -120,167 +226,376 @@ namespace TinyRenderer
 			}
 		}
 
-		const glm::ivec2 &A = v[0].m_spos;
-		const glm::ivec2 &B = v[1].m_spos;
-		const glm::ivec2 &C = v[2].m_spos;
-
-		const int I01 = A.y - B.y, I02 = B.y - C.y, I03 = C.y - A.y;
-		const int J01 = B.x - A.x, J02 = C.x - B.x, J03 = A.x - C.x;
-		const int K01 = A.x * B.y - A.y * B.x;
-		const int K02 = B.x * C.y - B.y * C.x;
-		const int K03 = C.x * A.y - C.y * A.x;
-
-		int F01 = I01 * boundingMin.x + J01 * boundingMin.y + K01;
-		int F02 = I02 * boundingMin.x + J02 * boundingMin.y + K02;
-		int F03 = I03 * boundingMin.x + J03 * boundingMin.y + K03;
+		const glm::i64vec2 A = glm::i64vec2(v[0].m_spos);
+		const glm::i64vec2 B = glm::i64vec2(v[1].m_spos);
+		const glm::i64vec2 C = glm::i64vec2(v[2].m_spos);
+
+		//Note: the increments per sub-pixel unit fit in 32 bits, but the edge functions need 64-bit accumulation
+		const int I01 = static_cast<int>(A.y - B.y), I02 = static_cast<int>(B.y - C.y), I03 = static_cast<int>(C.y - A.y);
+		const int J01 = static_cast<int>(B.x - A.x), J02 = static_cast<int>(C.x - B.x), J03 = static_cast<int>(A.x - C.x);
+		const int64_t K01 = A.x * B.y - A.y * B.x;
+		const int64_t K02 = B.x * C.y - B.y * C.x;
+		const int64_t K03 = C.x * A.y - C.y * A.x;
+
+		//Note: the blocks are aligned to the tiles of hierarchical depth
+		const int blockSize = TRQuadCoverageSetup<Samples>::k_blockSize;
+		static_assert(TRQuadCoverageSetup<Samples>::k_blockSize == TRFrameBuffer::k_hizTileSize, 
+			"Blocks should be aligned to the tiles of hierarchical depth");
+		const glm::ivec2 blockMin = boundingMin - boundingMin % blockSize;
+
+		const int64_t blockMinX = static_cast<int64_t>(blockMin.x) * k_subPixelScale;
+		const int64_t blockMinY = static_cast<int64_t>(blockMin.y) * k_subPixelScale;
+		const int64_t F01 = I01 * blockMinX + J01 * blockMinY + K01;
+		const int64_t F02 = I02 * blockMinX + J02 * blockMinY + K02;
+		const int64_t F03 = I03 * blockMinX + J03 * blockMinY + K03;
 
 		//Degenerated to a line or a point
 		if (F01 + F02 + F03 == 0)
 			return;
 
-		rasterized_fragments.reserve((boundingMax.y - boundingMin.y) * (boundingMax.x - boundingMin.x));
+		//Increments of the edge functions per pixel
+		const glm::i64vec3 I = glm::i64vec3(I01, I02, I03) * static_cast<int64_t>(k_subPixelScale);
+		const glm::i64vec3 J = glm::i64vec3(J01, J02, J03) * static_cast<int64_t>(k_subPixelScale);
 
-		//Top left fill rule
-		const float offset = TRMaskPixelSampler::getSamplingNum() >= 4 ? 0.0 : +1.0;
-		const int E1_t = (((B.y > A.y) || (A.y == B.y && A.x < B.x)) ? 0 : offset);
-		const int E2_t = (((C.y > B.y) || (B.y == C.y && B.x < C.x)) ? 0 : offset);
-		const int E3_t = (((A.y > C.y) || (C.y == A.y && C.x < A.x)) ? 0 : offset);
+		rasterized_fragments.reserve(rasterized_fragments.size() + 
+			((boundingMax.y - boundingMin.y) / 2 + 1) * ((boundingMax.x - boundingMin.x) / 2 + 1));
 
-		int Cy1 = F01, Cy2 = F02, Cy3 = F03;
-		const float one_div_delta = 1.0f / (F01 + F02 + F03);
-
-		//Strict barycenteric weights calculation
-		auto barycentericWeight = [&](const float &x, const float &y) -> glm::vec3
+		//Top left fill rule
+		//Note: the integer edge functions are exact, so that the sampling points on the shared edges are
+		//      covered by exactly one of the triangles
+		const int E1_t = (((B.y > A.y) || (A.y == B.y && A.x < B.x)) ? 0 : 1);
+		const int E2_t = (((C.y > B.y) || (B.y == C.y && B.x < C.x)) ? 0 : 1);
+		const int E3_t = (((A.y > C.y) || (C.y == A.y && C.x < A.x)) ? 0 : 1);
+
+		const float one_div_delta = 1.0f / static_cast<float>(F01 + F02 + F03);
+
+		//Coverage of 2x2 fragments x sampling points evaluated at once by SIMD kernel
+		const TRQuadCoverageSetup<Samples> setup(glm::ivec3(I01, I02, I03), glm::ivec3(J01, J02, J03),
+			glm::ivec3(E1_t, E2_t, E3_t), glm::vec3(v[0].m_rhw, v[1].m_rhw, v[2].m_rhw), one_div_delta);
+		const TRQuadCoverageKernel<Samples> evaluatePartialQuad = getQuadCoverageKernel<Samples>(true, setup.m_wideEdges);
+		const TRQuadCoverageKernel<Samples> evaluateInsideQuad = getQuadCoverageKernel<Samples>(false, setup.m_wideEdges);
+
+		//Note: fragments beyond the bounding box are invalid
+		const int samplingNum = Samples;
+		const unsigned int fragmentMask = (1u << Samples) - 1;
+		const unsigned int leftColumnMask = fragmentMask | (fragmentMask << (2 * samplingNum));
+		const unsigned int rightColumnMask = (fragmentMask << samplingNum) | (fragmentMask << (3 * samplingNum));
+		const unsigned int bottomRowMask = fragmentMask | (fragmentMask << samplingNum);
+		const unsigned int topRowMask = (fragmentMask << (2 * samplingNum)) | (fragmentMask << (3 * samplingNum));
+
+		float coverageDepth[TRQuadCoverageSetup<Samples>::k_numLanes];
+		auto rasterizeQuad = [&](const int &x, const int &y, const glm::i64vec3 &Cx,
+			const TRQuadCoverageKernel<Samples> &evaluateQuadCoverage)
 		{
-			glm::vec3 s[2];
-			s[0] = glm::vec3(v[2].m_spos.x - v[0].m_spos.x, v[1].m_spos.x - v[0].m_spos.x, v[0].m_spos.x - x);
-			s[1] = glm::vec3(v[2].m_spos.y - v[0].m_spos.y, v[1].m_spos.y - v[0].m_spos.y, v[0].m_spos.y - y);
-			auto uf = glm::cross(s[0], s[1]);
-			return glm::vec3(1.f - (uf.x + uf.y) / uf.z, uf.y / uf.z, uf.x / uf.z);
+			//2x2 fragments block
+			unsigned int coverage = evaluateQuadCoverage(setup, Cx, coverageDepth);
+			if (x < boundingMin.x)
+				coverage &= ~leftColumnMask;
+			if (y < boundingMin.y)
+				coverage &= ~bottomRowMask;
+			if (x + 1 > boundingMax.x)
+				coverage &= ~rightColumnMask;
+			if (y + 1 > boundingMax.y)
+				coverage &= ~topRowMask;
+
+			//Note: at least one of them is inside the triangle.
+			if (coverage == 0)
+				return;
+
+			size_t index = rasterized_fragments.appendQuad(glm::ivec2(x, y), coverage, coverageDepth);
+			const glm::i64vec3 E[4] = { Cx, Cx + I, Cx + J, Cx + J + I };
+#pragma unroll 4
+			for (int f = 0; f < 4; ++f)
+			{
+				//Note: the edge functions are also the barycentric weights of the helper fragments outside
+				glm::vec3 uvw = glm::vec3(E[f].y, E[f].z, E[f].x) * one_div_delta;
+				rasterized_fragments.interpolate<Varyings>(index + f, v[0], v[1], v[2], uvw);
+			}
 		};
 
-		auto sampling_is_inside = [&](const int &x, const int &y, const int &Cx1, const int &Cx2, 
-			const int &Cx3, FragmentData &p) -> bool
+		//Hierarchical traversal: the blocks totally outside or occluded are skipped, 
+		//and the blocks totally inside are emitted without per-sample edge tests
+		glm::i64vec3 By(F01, F02, F03);
+		for (int by = blockMin.y; by <= boundingMax.y; by += blockSize)
 		{
-			//Invalid fragment
-			if (x > boundingMax.x || y > boundingMax.y)
-			{
-				p.m_spos = glm::ivec2(-1);
-				return false;
-			}
-			bool atLeastOneInside = false;
-			const int samplingNum = TRMaskPixelSampler::getSamplingNum();
-			auto samplingOffsetArray = TRMaskPixelSampler::getSamplingOffsets();
-#pragma unroll
-			for (int s = 0; s < samplingNum; ++s)
+			glm::i64vec3 Bx = By;
+			const int blockMaxY = glm::min(by + blockSize - 1, boundingMax.y);
+			for (int bx = blockMin.x; bx <= boundingMax.x; bx += blockSize)
 			{
-				const auto &offset = samplingOffsetArray[s];
-				//Edge function
-				const float E1 = Cx1 + offset.x * I01 + offset.y * J01;
-				const float E2 = Cx2 + offset.x * I02 + offset.y * J02;
-				const float E3 = Cx3 + offset.x * I03 + offset.y * J03;
-				//Note: Counter-clockwise winding order
-				if ((E1 + E1_t) <= 0 && (E2 + E2_t) <= 0 && (E3 + E3_t) <= 0)
+				const int blockMaxX = glm::min(bx + blockSize - 1, boundingMax.x);
+				const glm::ivec2 size(blockMaxX - bx + 1, blockMaxY - by + 1);
+				TRBlockCoverage blockCoverage = classifyBlockCoverage(setup, Bx, size);
+				//Coarse occlusion culling: all of the samples would fail the depth test
+				//Note: the bound is rounded as the depth of samples, since so is the stored depth, 
+				//      and a sample of the bound could still pass the equal test
+				if (blockCoverage != TR_BLOCK_OUTSIDE && hizBuffer != nullptr)
 				{
-					atLeastOneInside = true;
-					p.m_coverage[s] = 1;//Covered
-					//Note: each sampling point should have its own depth
-					glm::vec3 uvw = glm::vec3(E2, E3, E1) * one_div_delta;
-					p.m_coverageDepth[s] = VertexData::barycentricLerp(v[0].m_rhw, v[1].m_rhw, v[2].m_rhw, uvw);
+					const float hizDepth = hizBuffer->readHiZDepth(bx / blockSize, by / blockSize);
+					const float maxDepth = hizBuffer->quantizeDepth(evaluateBlockMaxDepth(setup, Bx, size));
+					if (depthFunc == TRDepthFunc::TR_DEPTH_FUNC_EQUAL ? hizDepth > maxDepth : hizDepth >= maxDepth)
+					{
+						blockCoverage = TR_BLOCK_OUTSIDE;
+					}
+				}
+				if (blockCoverage != TR_BLOCK_OUTSIDE)
+				{
+					const TRQuadCoverageKernel<Samples> &evaluateQuadCoverage = 
+						(blockCoverage == TR_BLOCK_INSIDE) ? evaluateInsideQuad : evaluatePartialQuad;
+					glm::i64vec3 Cy = Bx;
+					for (int y = by; y <= blockMaxY; y += 2)
+					{
+						glm::i64vec3 Cx = Cy;
+#pragma unroll 4
+						for (int x = bx; x <= blockMaxX; x += 2)
+						{
+							rasterizeQuad(x, y, Cx, evaluateQuadCoverage);
+							Cx += static_cast<int64_t>(2) * I;
+						}
+						Cy += static_cast<int64_t>(2) * J;
+					}
 				}
+				Bx += static_cast<int64_t>(blockSize) * I;
 			}
+			By += static_cast<int64_t>(blockSize) * J;
+		}
+	}
 
-			if (!atLeastOneInside)
+	template<unsigned int Varyings>
+	void TRShadingPipeline::reconstructQuadFragments(
+		const VertexData &v0,
+		const VertexData &v1,
+		const VertexData &v2,
+		const glm::ivec2 &pos,
+		const unsigned int &coverage,
+		const float *coverageDepth,
+		QuadFragmentStream &fragments)
+	{
+		//Note: the same order and edge functions as rasterizeFillEdgeFunction()
+		const VertexData *v[] = { &v0, &v1, &v2 };
+		{
+			const glm::i64vec2 e1 = glm::i64vec2(v1.m_spos - v0.m_spos);
+			const glm::i64vec2 e2 = glm::i64vec2(v2.m_spos - v0.m_spos);
+			if (e1.x * e2.y - e1.y * e2.x > 0)
 			{
-				p.m_spos = glm::ivec2(-1);
+				std::swap(v[1], v[2]);
 			}
-			return atLeastOneInside;
-		};
+		}
 
-		for(int y = boundingMin.y;y <= boundingMax.y;y += 2)
-		{
-			int Cx1 = Cy1, Cx2 = Cy2, Cx3 = Cy3;
+		const glm::i64vec2 A = glm::i64vec2(v[0]->m_spos);
+		const glm::i64vec2 B = glm::i64vec2(v[1]->m_spos);
+		const glm::i64vec2 C = glm::i64vec2(v[2]->m_spos);
+
+		const glm::i64vec3 I(A.y - B.y, B.y - C.y, C.y - A.y);
+		const glm::i64vec3 J(B.x - A.x, C.x - B.x, A.x - C.x);
+		const glm::i64vec3 K(A.x * B.y - A.y * B.x, B.x * C.y - B.y * C.x, C.x * A.y - C.y * A.x);
+		const glm::i64vec3 F = I * (static_cast<int64_t>(pos.x) * k_subPixelScale)
+			+ J * (static_cast<int64_t>(pos.y) * k_subPixelScale) + K;
+		const float one_div_delta = 1.0f / static_cast<float>(F.x + F.y + F.z);
+
+		//Increments of the edge functions per pixel
+		const glm::i64vec3 Ipx = I * static_cast<int64_t>(k_subPixelScale);
+		const glm::i64vec3 Jpx = J * static_cast<int64_t>(k_subPixelScale);
+
+		size_t index = fragments.appendQuad(pos, coverage, coverageDepth);
+		const glm::i64vec3 E[4] = { F, F + Ipx, F + Jpx, F + Jpx + Ipx };
 #pragma unroll 4
-			for (int x = boundingMin.x; x <= boundingMax.x; x += 2)
+		for (int f = 0; f < 4; ++f)
+		{
+			glm::vec3 uvw = glm::vec3(E[f].y, E[f].z, E[f].x) * one_div_delta;
+			fragments.interpolate<Varyings>(index + f, *v[0], *v[1], *v[2], uvw);
+		}
+	}
+
+	//Instantiation of the precompiled interpolant layouts x the sampling numbers of MSAA
+#define TR_INSTANTIATE_RASTERIZER(Varyings, Samples) \
+	template void TRShadingPipeline::rasterizeFillEdgeFunction<Varyings, Samples>(const VertexData &, \
+		const VertexData &, const VertexData &, const unsigned int &, const unsigned int &, \
+		QuadFragmentStream &, const TRFrameBuffer *, const TRDepthFunc &); \
+	template void TRShadingPipeline::rasterizeFillEdgeFunction<Varyings, Samples>(const VertexData &, \
+		const VertexData &, const VertexData &, const glm::ivec2 &, const glm::ivec2 &, \
+		QuadFragmentStream &, const TRFrameBuffer *, const TRDepthFunc &);
+
+#define TR_INSTANTIATE_VARYINGS_LAYOUT(Varyings) \
+	template TRShadingPipeline::VertexData TRShadingPipeline::VertexData::lerp<Varyings>( \
+		const VertexData &, const VertexData &, float); \
+	template void TRShadingPipeline::VertexData::prePerspCorrection<Varyings>(VertexData &); \
+	TR_INSTANTIATE_RASTERIZER(Varyings, 1) \
+	TR_INSTANTIATE_RASTERIZER(Varyings, 2) \
+	TR_INSTANTIATE_RASTERIZER(Varyings, 4) \
+	TR_INSTANTIATE_RASTERIZER(Varyings, 8) \
+	template void TRShadingPipeline::reconstructQuadFragments<Varyings>(const VertexData &, const VertexData &, \
+		const VertexData &, const glm::ivec2 &, const unsigned int &, const float *, QuadFragmentStream &);
+
+	TR_INSTANTIATE_VARYINGS_LAYOUT(TRShadingPipeline::k_varyingsNone)
+	TR_INSTANTIATE_VARYINGS_LAYOUT(TRShadingPipeline::k_varyingsTexcoord)
+	TR_INSTANTIATE_VARYINGS_LAYOUT(TRShadingPipeline::k_varyingsLighting)
+	TR_INSTANTIATE_VARYINGS_LAYOUT(TRShadingPipeline::k_varyingsAll)
+
+#undef TR_INSTANTIATE_VARYINGS_LAYOUT
+#undef TR_INSTANTIATE_RASTERIZER
+
+	void TRShadingPipeline::vertexShaderBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+		const unsigned int &/*varyings*/) const
+	{
+		for (size_t i = 0; i < n; ++i)
+		{
+			out[i].m_pos = in[i].m_vpositions;
+			out[i].m_nor = in[i].m_vnormals;
+			out[i].m_tex = in[i].m_vtexcoords;
+			out[i].m_tbn[0] = in[i].m_vtangent;
+			out[i].m_tbn[1] = in[i].m_vbitangent;
+			vertexShader(out[i]);
+		}
+	}
+
+	void TRShadingPipeline::fragmentShaderQuad(const FragmentData *data, const unsigned int &mask, glm::vec4 *fragColor,
+		const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const
+	{
+		//Shading the fragments one by one
+		for (int f = 0; f < 4; ++f)
+		{
+			if (mask & (1u << f))
 			{
-				//2x2 fragments block
-				QuadFragments group;
-				bool inside0 = sampling_is_inside(x, y, Cx1, Cx2, Cx3, group.m_fragments[0]);
-				bool inside1 = sampling_is_inside(x + 1, y, Cx1 + I01, Cx2 + I02, Cx3 + I03, group.m_fragments[1]);
-				bool inside2 = sampling_is_inside(x, y + 1, Cx1 + J01, Cx2 + J02, Cx3 + J03, group.m_fragments[2]);
-				bool inside3 = sampling_is_inside(x + 1, y + 1, Cx1 + J01 + I01, Cx2 + J02 + I02, Cx3 + J03 + I03, group.m_fragments[3]);
-				//Note: at least one of them is inside the triangle.
-				if (inside0 || inside1 || inside2 || inside3)
-				{
-					if (!inside0)//Invalid fragment
-					{
-						group.m_fragments[0] = VertexData::barycentricLerp(v[0], v[1], v[2], barycentericWeight(x, y));
-						group.m_fragments[0].m_spos = glm::ivec2(-1);
-					}
-					else
-					{
-						glm::vec3 uvw(Cx2, Cx3, Cx1);
-						auto coverage = group.m_fragments[0].m_coverage;
-						auto coverage_depth = group.m_fragments[0].m_coverageDepth;
-						group.m_fragments[0] = VertexData::barycentricLerp(v[0], v[1], v[2], uvw * one_div_delta);
-						group.m_fragments[0].m_spos = glm::ivec2(x, y);
-						group.m_fragments[0].m_coverage = coverage;
-						group.m_fragments[0].m_coverageDepth = coverage_depth;
-					}
+				fragmentShader(data[f], fragColor[f], dUVdx, dUVdy);
+			}
+		}
+	}
 
-					if (!inside1)//Invalid fragment
-					{
-						group.m_fragments[1] = VertexData::barycentricLerp(v[0], v[1], v[2], barycentericWeight(x + 1, y));
-						group.m_fragments[1].m_spos = glm::ivec2(-1);
-					}
-					else
-					{
-						glm::vec3 uvw(Cx2 + I02, Cx3 + I03, Cx1 + I01);
-						auto coverage = group.m_fragments[1].m_coverage;
-						auto coverage_depth = group.m_fragments[1].m_coverageDepth;
-						group.m_fragments[1] = VertexData::barycentricLerp(v[0], v[1], v[2], uvw * one_div_delta);
-						group.m_fragments[1].m_spos = glm::ivec2(x + 1, y);
-						group.m_fragments[1].m_coverage = coverage;
-						group.m_fragments[1].m_coverageDepth = coverage_depth;
-					}
+#ifdef TR_SIMD_X86
+	//Note: the same order of operations as glm, hence identical to the scalar results
+	TR_TARGET_AVX2
+	static inline void transformPoint8(const glm::mat4 &m, const __m256 p[3], __m256 r[4])
+	{
+		for (int c = 0; c < 4; ++c)
+		{
+			//(m0 * x + m1 * y) + (m2 * z + m3 * 1)
+			r[c] = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[0][c]), p[0]), _mm256_mul_ps(_mm256_set1_ps(m[1][c]), p[1])),
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[2][c]), p[2]), _mm256_set1_ps(m[3][c])));
+		}
+	}
 
-					if (!inside2)//Invalid fragment
-					{
-						group.m_fragments[2] = VertexData::barycentricLerp(v[0], v[1], v[2], barycentericWeight(x, y + 1));
-						group.m_fragments[2].m_spos = glm::ivec2(-1);
-					}
-					else
-					{
-						glm::vec3 uvw(Cx2 + J02, Cx3 + J03, Cx1 + J01);
-						auto coverage = group.m_fragments[2].m_coverage;
-						auto coverage_depth = group.m_fragments[2].m_coverageDepth;
-						group.m_fragments[2] = VertexData::barycentricLerp(v[0], v[1], v[2], uvw * one_div_delta);
-						group.m_fragments[2].m_spos = glm::ivec2(x, y + 1);
-						group.m_fragments[2].m_coverage = coverage;
-						group.m_fragments[2].m_coverageDepth = coverage_depth;
-					}
+	TR_TARGET_AVX2
+	static inline void transformNormal8(const glm::mat3 &m, const __m256 n[3], __m256 r[3])
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			//(m0 * x + m1 * y) + m2 * z
+			r[c] = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[0][c]), n[0]), _mm256_mul_ps(_mm256_set1_ps(m[1][c]), n[1])),
+				_mm256_mul_ps(_mm256_set1_ps(m[2][c]), n[2]));
+		}
+		//Normalization: v * (1 / sqrt(dot(v, v)))
+		__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r[0], r[0]), _mm256_mul_ps(r[1], r[1])), 
+			_mm256_mul_ps(r[2], r[2]));
+		__m256 invLen = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(dot));
+		for (int c = 0; c < 3; ++c)
+		{
+			r[c] = _mm256_mul_ps(r[c], invLen);
+		}
+	}
 
-					if (!inside3)//Invalid fragment
-					{
-						group.m_fragments[3] = VertexData::barycentricLerp(v[0], v[1], v[2], barycentericWeight(x + 1, y + 1));
-						group.m_fragments[3].m_spos = glm::ivec2(-1);
-					}
-					else
-					{
-						glm::vec3 uvw(Cx2 + J02 + I02, Cx3 + J03 + I03, Cx1 + J01 + I01);
-						auto coverage = group.m_fragments[3].m_coverage;
-						auto coverage_depth = group.m_fragments[3].m_coverageDepth;
-						group.m_fragments[3] = VertexData::barycentricLerp(v[0], v[1], v[2], uvw * one_div_delta);
-						group.m_fragments[3].m_spos = glm::ivec2(x + 1, y + 1);
-						group.m_fragments[3].m_coverage = coverage;
-						group.m_fragments[3].m_coverageDepth = coverage_depth;
-					}
+	//Gather a vec3 field of 8 vertices into SoA form
+	TR_TARGET_AVX2
+	static inline void gatherVec3x8(const float *field, const __m256i &lanes, __m256 r[3])
+	{
+		for (int c = 0; c < 3; ++c)
+			r[c] = _mm256_i32gather_ps(field + c, lanes, 4);
+	}
+
+	TR_TARGET_AVX2
+	static size_t transformVerticesAVX2(const TRVertex *in, const size_t &n, TRShadingPipeline::VertexData *out, 
+		const unsigned int &varyings, const glm::mat4 &model, const glm::mat4 &viewProject, const glm::mat3 &invTransModel)
+	{
+		//Note: the normal is the third axis of the tangent frame
+		const bool tangentFrame = (varyings & TR_VARYING_TBN) != 0;
+		const bool normals = (varyings & (TR_VARYING_NORMAL | TR_VARYING_TBN)) != 0;
+		static_assert(sizeof(TRVertex) % sizeof(float) == 0, "Vertex should consist of floats");
+		const int stride = sizeof(TRVertex) / sizeof(float);
+		const __m256i lanes = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+
+		alignas(32) float world[3][8], clip[4][8], normal[3][8], tangent[3][8], bitangent[3][8];
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 p[3], w[4], c[4], nor[3], r[3];
+			gatherVec3x8(&in[i].m_vpositions.x, lanes, p);
+			transformPoint8(model, p, w);
+			transformPoint8(viewProject, w, c);
+			for (int k = 0; k < 3; ++k)
+				_mm256_store_ps(world[k], w[k]);
+			for (int k = 0; k < 4; ++k)
+				_mm256_store_ps(clip[k], c[k]);
+
+			if (normals)
+			{
+				gatherVec3x8(&in[i].m_vnormals.x, lanes, nor);
+				transformNormal8(invTransModel, nor, r);
+				for (int k = 0; k < 3; ++k)
+					_mm256_store_ps(normal[k], r[k]);
+			}
 
-					rasterized_fragments.push_back(group);
+			if (tangentFrame)
+			{
+				gatherVec3x8(&in[i].m_vtangent.x, lanes, nor);
+				transformNormal8(invTransModel, nor, r);
+				for (int k = 0; k < 3; ++k)
+					_mm256_store_ps(tangent[k], r[k]);
+				gatherVec3x8(&in[i].m_vbitangent.x, lanes, nor);
+				transformNormal8(invTransModel, nor, r);
+				for (int k = 0; k < 3; ++k)
+					_mm256_store_ps(bitangent[k], r[k]);
+			}
+
+			//Scatter back to vertices
+			for (int l = 0; l < 8; ++l)
+			{
+				auto &v = out[i + l];
+				v.m_pos = glm::vec3(world[0][l], world[1][l], world[2][l]);
+				v.m_cpos = glm::vec4(clip[0][l], clip[1][l], clip[2][l], clip[3][l]);
+				if (normals)
+					v.m_nor = glm::vec3(normal[0][l], normal[1][l], normal[2][l]);
+				if (varyings & TR_VARYING_TEXCOORD)
+					v.m_tex = in[i + l].m_vtexcoords;
+				if (tangentFrame)
+				{
+					v.m_tbn = glm::mat3(glm::vec3(tangent[0][l], tangent[1][l], tangent[2][l]),
+						glm::vec3(bitangent[0][l], bitangent[1][l], bitangent[2][l]), v.m_nor);
 				}
-				Cx1 += 2 * I01; Cx2 += 2 * I02; Cx3 += 2 * I03;
 			}
-			Cy1 += 2 * J01;	Cy2 += 2 * J02; Cy3 += 2 * J03;
+		}
+		return i;
+	}
+#endif
+
+	void TRShadingPipeline::transformVerticesBatch(const TRVertex *in, const size_t &n, VertexData *out, 
+		const unsigned int &varyings) const
+	{
+		size_t i = 0;
+#ifdef TR_SIMD_X86
+		if (isAVX2Supported())
+		{
+			i = transformVerticesAVX2(in, n, out, varyings, m_modelMatrix, m_viewProjectMatrix, m_invTransModelMatrix);
+		}
+#endif
+		//The remaining ones
+		const bool tangentFrame = (varyings & TR_VARYING_TBN) != 0;
+		const bool normals = (varyings & (TR_VARYING_NORMAL | TR_VARYING_TBN)) != 0;
+		for (; i < n; ++i)
+		{
+			auto &v = out[i];
+			v.m_pos = glm::vec3(m_modelMatrix * glm::vec4(in[i].m_vpositions, 1.0f));
+			v.m_cpos = m_viewProjectMatrix * glm::vec4(v.m_pos, 1.0f);
+			if (normals)
+				v.m_nor = glm::normalize(m_invTransModelMatrix * in[i].m_vnormals);
+			if (varyings & TR_VARYING_TEXCOORD)
+				v.m_tex = in[i].m_vtexcoords;
+			if (tangentFrame)
+			{
+				glm::vec3 T = glm::normalize(m_invTransModelMatrix * in[i].m_vtangent);
+				glm::vec3 B = glm::normalize(m_invTransModelMatrix * in[i].m_vbitangent);
+				v.m_tbn = glm::mat3(T, B, v.m_nor);
+			}
 		}
 	}
 
@@ -288,8 +603,8 @@ namespace TinyRenderer
 	{
 		if (tex != nullptr)
 		{
-			m_globalTextureUnits.push_back(tex);
-			return m_globalTextureUnits.size() - 1;
+			auto iter = m_globalTextureUnits.push_back(tex);
+			return iter - m_globalTextureUnits.begin();
 		}
 		return -1;
 	}
@@ -301,35 +616,27 @@ namespace TinyRenderer
 		return m_globalTextureUnits[index];
 	}
 
-	int TRShadingPipeline::addLight(TRLight::ptr lightSource)
-	{
-		m_lights.push_back(lightSource);
-		return m_lights.size() - 1;
-	}
-
-	TRLight::ptr TRShadingPipeline::getLight(int index)
-	{
-		return m_lights[index];
-	}
-
 	glm::vec4 TRShadingPipeline::texture2D(const unsigned int &id, const glm::vec2 &uv,
 		const glm::vec2 &dUVdx, const glm::vec2 &dUVdy)
 	{
 		if (id < 0 || id >= m_globalTextureUnits.size())
 			return glm::vec4(0.0f);
-		const auto &texture = m_globalTextureUnits[id];
-		if (texture->isGeneratedMipmap())
-		{
-			//Calculate lod level
-			glm::vec2 dfdx = dUVdx * glm::vec2(texture->getWidth(), texture->getHeight());
-			glm::vec2 dfdy = dUVdy * glm::vec2(texture->getWidth(), texture->getHeight());
-			float L = glm::max(glm::dot(dfdx, dfdx), glm::dot(dfdy, dfdy));
-			return texture->sample(uv, glm::max(0.5f * glm::log2(L), 0.0f));
-		}
-		else
+		//Note: the lod level (and the anisotropic taps) is selected by the texture
+		return m_globalTextureUnits[id]->sample(uv, dUVdx, dUVdy);
+	}
+
+	void TRShadingPipeline::texture2DQuad(const unsigned int &id, const FragmentData *data,
+		const glm::vec2 &dUVdx, const glm::vec2 &dUVdy, glm::vec4 *texels)
+	{
+		if (id >= m_globalTextureUnits.size())
 		{
-			return texture->sample(uv);
+			texels[0] = texels[1] = texels[2] = texels[3] = glm::vec4(0.0f);
+			return;
 		}
+		const auto &texture = m_globalTextureUnits[id];
+		const glm::vec2 uv[4] = { data[0].m_tex, data[1].m_tex, data[2].m_tex, data[3].m_tex };
+		//Note: the lod level is shared by the 2x2 fragments block
+		texture->sampleQuad(uv, dUVdx, dUVdy, texels);
 	}
 
 }
\ No newline at end of file
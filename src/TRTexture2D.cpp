@@ -4,6 +4,7 @@
 #include "stb_image.h"
 
 #include "TRParallelWrapper.h"
+#include "TRSIMD.h"
 
 #include <iostream>
 
@@ -11,6 +12,8 @@ namespace TinyRenderer
 {
 	//----------------------------------------------TRTexture2D----------------------------------------------
 
+	constexpr int TRTexture2D::k_maxAnisotropy;
+
 	TRTexture2D::TRTexture2D() :
 		m_generateMipmap(false),
 		m_warpMode(TRTextureWarpMode::TR_MIRRORED_REPEAT),
@@ -23,26 +26,36 @@ namespace TinyRenderer
 
 	void TRTexture2D::setWarpingMode(TRTextureWarpMode mode) { m_warpMode = mode; }
 	void TRTexture2D::setFilteringMode(TRTextureFilterMode mode) { m_filteringMode = mode; }
+	void TRTexture2D::setMaxAnisotropy(const int &maxAnisotropy) { m_maxAnisotropy = glm::clamp(maxAnisotropy, 1, k_maxAnisotropy); }
+	void TRTexture2D::setTexelFormat(TRTextureFormat format) { m_texelFormat = format; m_autoTexelFormat = false; }
 
 	bool TRTexture2D::loadTextureFromFile(
 		const std::string &filepath,
 		TRTextureWarpMode warpMode,
-		TRTextureFilterMode filterMode)
+		TRTextureFilterMode filterMode,
+		TRTextureCompressionMode compressionMode)
 	{
 		m_warpMode = warpMode;
 		m_filteringMode = filterMode;
+		m_compressionMode = compressionMode;
 		std::vector<TRTextureHolder::ptr>().swap(m_texHolders);
 
+		//Note: HDR images are loaded as linear float
+		const bool hdr = stbi_is_hdr(filepath.c_str()) != 0;
 		unsigned char *pixels = nullptr;
+		float *hdrPixels = nullptr;
 
 		//Load image from given file using stb_image.h
 		//Refs: https://github.com/nothings/stb
 		int width, height, channel;
 		{
 			//stbi_set_flip_vertically_on_load(true);
-			pixels = stbi_load(filepath.c_str(), &width, &height, &channel, 0);
+			if (hdr)
+				hdrPixels = stbi_loadf(filepath.c_str(), &width, &height, &channel, 0);
+			else
+				pixels = stbi_load(filepath.c_str(), &width, &height, &channel, 0);
 
-			if (pixels == nullptr)
+			if (pixels == nullptr && hdrPixels == nullptr)
 			{
 				std::cerr << "Failed to load image from " << filepath << std::endl;
 				exit(1);
@@ -55,53 +68,113 @@ namespace TinyRenderer
 			}
 		}
 
-		//32bpp
-		unsigned char *raw = new unsigned char[width * height * 4];
-		parallelFor((int)0, (int)(width * height), [&](const int &index)
+		//Note: the channels of image are converted to the texel format by the texture holders
+		if (m_autoTexelFormat)
+		{
+			m_texelFormat = hdr ? TRTextureFormat::TR_TEXTURE_FORMAT_RGBA16F : selectTexelFormat(pixels, width * height, channel);
+		}
+
+		//Block compressed layout of the levels
+		if (hdr && m_compressionMode != TRTextureCompressionMode::TR_TEXTURE_COMPRESSION_DISABLE)
+		{
+			std::cout << "Warning: block compression of HDR image is not supported\n";
+			m_compressionMode = TRTextureCompressionMode::TR_TEXTURE_COMPRESSION_DISABLE;
+		}
+		switch (m_compressionMode)
 		{
-			unsigned char &r = raw[index * 4 + 0];
-			unsigned char &g = raw[index * 4 + 1];
-			unsigned char &b = raw[index * 4 + 2];
-			unsigned char &a = raw[index * 4 + 3];
-			int fromIndex = index * channel;
-			switch (channel)
+		case TRTextureCompressionMode::TR_TEXTURE_COMPRESSION_COLOR:
+		{
+			//BC3 only if the alpha channel is used
+			bool opaque = true;
+			//Note: the last channel of gray (2 channels) and RGBA images is alpha
+			for (int index = 0; index < width * height && opaque && (channel == 2 || channel == 4); ++index)
 			{
-			case 1:
-				r = g = b = pixels[fromIndex], a = 255;
-				break;
-			case 3:
-				r = pixels[fromIndex], g = pixels[fromIndex + 1], b = pixels[fromIndex + 2], a = 255;
-				break;
-			case 4:
-				r = pixels[fromIndex], g = pixels[fromIndex + 1], b = pixels[fromIndex + 2], a = pixels[fromIndex + 3];
-				break;
-			default:
-				r = g = b = pixels[fromIndex], a = 255;
-				break;
+				opaque = pixels[index * channel + channel - 1] == 255;
 			}
-		}, TRExecutionPolicy::TR_PARALLEL);
-		channel = 4;
-		stbi_image_free(pixels);
-		pixels = nullptr;
+			m_compressedLayout = opaque ? TRTextureLayout::TR_TEXTURE_LAYOUT_BC1 : TRTextureLayout::TR_TEXTURE_LAYOUT_BC3;
+			break;
+		}
+		case TRTextureCompressionMode::TR_TEXTURE_COMPRESSION_GRAY:
+			m_compressedLayout = TRTextureLayout::TR_TEXTURE_LAYOUT_BC4;
+			break;
+		case TRTextureCompressionMode::TR_TEXTURE_COMPRESSION_NORMAL:
+			m_compressedLayout = TRTextureLayout::TR_TEXTURE_LAYOUT_BC5;
+			break;
+		default:
+			break;
+		}
 
 		//Generate resolution pyramid for mipmap
 		if (m_generateMipmap)
 		{
-			generateMipmap(raw, width, height, channel);
+			if (hdr)
+				generateMipmap(hdrPixels, width, height, channel);
+			else
+				generateMipmap(pixels, width, height, channel);
 		}
 		else
 		{
-			m_texHolders = { std::make_shared<TRZCurveTilingTextureHolder>(raw, width, height, channel) };
+			m_texHolders = { hdr ?
+				createTextureHolder(hdrPixels, width, height, channel, TRTextureLayout::TR_TEXTURE_LAYOUT_ZCURVE_TILING) :
+				createTextureHolder(pixels, width, height, channel, TRTextureLayout::TR_TEXTURE_LAYOUT_ZCURVE_TILING) };
 		}
 
-		delete[] raw;
+		stbi_image_free(hdr ? (void*)hdrPixels : (void*)pixels);
 
 		return true;
 	}
 
-	void TRTexture2D::generateMipmap(unsigned char *pixels, int width, int height, int channel)
+	TRTextureFormat TRTexture2D::selectTexelFormat(const unsigned char *pixels, const int &nPixels, const int &channel) const
 	{
-		unsigned char *rawData = pixels;
+		if (channel == 1)
+			return TRTextureFormat::TR_TEXTURE_FORMAT_R8;
+
+		//Gray and opaque, e.g. specular maps saved as RGB
+		//Note: gray images with alpha (2 channels) are expanded to RGBA8 so as to keep the alpha
+		for (int index = 0; index < nPixels; ++index)
+		{
+			const unsigned char *pixel = &pixels[index * channel];
+			const bool gray = channel == 2 || (pixel[0] == pixel[1] && pixel[0] == pixel[2]);
+			const bool opaque = (channel == 3) || pixel[channel - 1] == 255;
+			if (!gray || !opaque)
+				return TRTextureFormat::TR_TEXTURE_FORMAT_RGBA8;
+		}
+		return TRTextureFormat::TR_TEXTURE_FORMAT_R8;
+	}
+
+	template<typename T>
+	TRTextureHolder::ptr TRTexture2D::createTextureHolder(const T *data, int width, int height, int channel,
+		TRTextureLayout layout) const
+	{
+		//Note: the compressed layout takes precedence over the given one
+		if (m_compressionMode != TRTextureCompressionMode::TR_TEXTURE_COMPRESSION_DISABLE)
+		{
+			layout = m_compressedLayout;
+		}
+
+		switch (layout)
+		{
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_TILING:
+			return std::make_shared<TRTilingTextureHolder>(data, width, height, channel, m_texelFormat);
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_ZCURVE_TILING:
+			return std::make_shared<TRZCurveTilingTextureHolder>(data, width, height, channel, m_texelFormat);
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_BC1:
+			return std::make_shared<TRBC1TextureHolder>(data, width, height, channel);
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_BC3:
+			return std::make_shared<TRBC3TextureHolder>(data, width, height, channel);
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_BC4:
+			return std::make_shared<TRBC4TextureHolder>(data, width, height, channel);
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_BC5:
+			return std::make_shared<TRBC5TextureHolder>(data, width, height, channel);
+		default:
+			return std::make_shared<TRLinearTextureHolder>(data, width, height, channel, m_texelFormat);
+		}
+	}
+
+	template<typename T>
+	void TRTexture2D::generateMipmap(T *pixels, int width, int height, int channel)
+	{
+		T *rawData = pixels;
 		bool reAlloc = false;
 
 		//Find the first greater number which equals to 2^n
@@ -125,45 +198,33 @@ namespace TinyRenderer
 			nw = glm::max(nw, nh);
 			nh = glm::max(nw, nh);
 			reAlloc = true;
-			rawData = new unsigned char[nw * nh * channel];
+			rawData = new T[nw * nh * channel];
 
-			auto readPixels = [&](const int &x, const int &y, unsigned char &r, unsigned char &g, unsigned char &b, unsigned char &a) -> void
+			auto readPixels = [&](const int &x, const int &y) -> const T*
 			{
 				int tx = (x >= width) ? (width - 1) : x;
 				int ty = (y >= height) ? (height - 1) : y;
-				r = pixels[(ty*width + tx) * channel + 0];
-				g = pixels[(ty*width + tx) * channel + 1];
-				b = pixels[(ty*width + tx) * channel + 2];
-				a = pixels[(ty*width + tx) * channel + 3];
+				return &pixels[(ty*width + tx) * channel];
 			};
 
 			parallelFor((int)0, (int)(nw * nh), [&](const int &index) -> void
 			{
 				float x = (float)(index % nw)/(float)(nw - 1) * (width - 1);
 				float y = (float)(index / nw)/(float)(nh - 1) * (height - 1);
-				unsigned char r, g, b, a;
 				//Binlear interpolation for scaling
 				{
 					int ix = (int)x, iy = (int)y;
 					int fx = x - ix, fy = y - iy;
 
-					unsigned char p[4][4];
-					readPixels(ix, iy, p[0][0], p[0][1], p[0][2], p[0][3]);
-					readPixels(ix + 1, iy, p[1][0], p[1][1], p[1][2], p[1][3]);
-					readPixels(ix, iy + 1, p[2][0], p[2][1], p[2][2], p[2][3]);
-					readPixels(ix + 1, iy + 1, p[3][0], p[3][1], p[3][2], p[3][3]);
+					const T *p[4] = { readPixels(ix, iy), readPixels(ix + 1, iy), readPixels(ix, iy + 1), readPixels(ix + 1, iy + 1) };
 
 					float w0 = (1.0f - fx) * (1.0f - fy), w1 = fx * (1.0f - fy);
 					float w2 = (1.0f - fx) * fy, w3 = fx * fy;
-					r = (unsigned char)(w0 * p[0][0] + w1 * p[1][0] + w2 * p[2][0] + w3 * p[3][0]);
-					g = (unsigned char)(w0 * p[0][1] + w1 * p[1][1] + w2 * p[2][1] + w3 * p[3][1]);
-					b = (unsigned char)(w0 * p[0][2] + w1 * p[1][2] + w2 * p[2][2] + w3 * p[3][2]);
-					a = (unsigned char)(w0 * p[0][3] + w1 * p[1][3] + w2 * p[2][3] + w3 * p[3][3]);
+					for (int c = 0; c < channel; ++c)
+					{
+						rawData[index * channel + c] = (T)(w0 * p[0][c] + w1 * p[1][c] + w2 * p[2][c] + w3 * p[3][c]);
+					}
 				}
-				rawData[index * channel] = r;
-				rawData[index * channel + 1] = g; 
-				rawData[index * channel + 2] = b;
-				rawData[index * channel + 3] = a;
 			});
 			width = nw;
 			height = nh;
@@ -172,12 +233,12 @@ namespace TinyRenderer
 		
 		//First level
 		int curW = width, curH = height;
-		m_texHolders.push_back(std::make_shared<TRZCurveTilingTextureHolder>(rawData, curW, curH, channel));
+		m_texHolders.push_back(createTextureHolder(rawData, curW, curH, channel, TRTextureLayout::TR_TEXTURE_LAYOUT_ZCURVE_TILING));
 
 		//The rest of levels
-		unsigned char *previous = rawData;
-		unsigned char *tmpAlloc = new unsigned char[curW * curH * channel];
-		unsigned char *current = tmpAlloc;
+		T *previous = rawData;
+		T *tmpAlloc = new T[curW * curH * channel];
+		T *current = tmpAlloc;
 		while(curW >= 2)
 		{
 			curW /= 2, curH /= 2;
@@ -185,21 +246,17 @@ namespace TinyRenderer
 			{
 				int x = index % curW;
 				int y = index / curW;
-				unsigned char r, g, b, a;
 				int destX = 2 * x, destY = 2 * y;
 				int target1 = (destY * curW * 2 + destX) * channel;
 				int target2 = (destY * curW * 2 + destX + 1) * channel;
 				int target3 = ((destY + 1) * curW * 2 + destX) * channel;
 				int target4 = ((destY + 1) * curW * 2 + destX + 1) * channel;
 				//Box filtering for down-sampling
-				r = (previous[target1 + 0] + previous[target2 + 0] + previous[target3 + 0] + previous[target4 + 0]) * 0.25;
-				g = (previous[target1 + 1] + previous[target2 + 1] + previous[target3 + 1] + previous[target4 + 1]) * 0.25;
-				b = (previous[target1 + 2] + previous[target2 + 2] + previous[target3 + 2] + previous[target4 + 2]) * 0.25;
-				a = (previous[target1 + 3] + previous[target2 + 3] + previous[target3 + 3] + previous[target4 + 3]) * 0.25;
-				current[index * channel + 0] = r;
-				current[index * channel + 1] = g;
-				current[index * channel + 2] = b;
-				current[index * channel + 3] = a;
+				for (int c = 0; c < channel; ++c)
+				{
+					current[index * channel + c] = (T)((previous[target1 + c] + previous[target2 + c] + 
+						previous[target3 + c] + previous[target4 + c]) * 0.25);
+				}
 			});
 
 			//Note: Tiling and ZCuve mapping are also time-consuming
@@ -211,7 +268,7 @@ namespace TinyRenderer
 			//{
 			//	m_texHolders.push_back(std::make_shared<TRLinearTextureHolder>(current, curW, curH, channel));
 			//}
-			m_texHolders.push_back(std::make_shared<TRTilingTextureHolder>(current, curW, curH, channel));
+			m_texHolders.push_back(createTextureHolder(current, curW, curH, channel, TRTextureLayout::TR_TEXTURE_LAYOUT_TILING));
 			//m_texHolders.push_back(std::make_shared<TRLinearTextureHolder>(current, curW, curH, channel));
 			std::swap(current, previous);
 		}
@@ -223,142 +280,305 @@ namespace TinyRenderer
 		}
 	}
 
-	void TRTexture2D::readPixel(const std::uint16_t &u, const std::uint16_t &v, unsigned char &r, 
-		unsigned char &g, unsigned char &b, unsigned char &a, const int level) const
-	{
-		//Please make sure that loadTextureFromFile() had been called.
-		//Note: guarantee that u and v are in [0,width-1],[0,height-1] respectively.
-		std::uint32_t texel = m_texHolders[level]->read(u, v);
-		r = (texel >> 24) & 0xFF;
-		g = (texel >> 16) & 0xFF;
-		b = (texel >>  8) & 0xFF;
-		a = (texel >>  0) & 0xFF;
-	}
-
 	glm::vec4 TRTexture2D::sample(const glm::vec2 &uv, const float &level) const
 	{
 		//Perform sampling procedure
 		//Note: return texel that ranges from 0.0f to 1.0f instead of [0,255]
-		float u = uv.x, v = uv.y;
 		//Texture warpping mode
+		float u = TRTexture2DSampler::warpCoordinate(uv.x, m_warpMode);
+		float v = TRTexture2DSampler::warpCoordinate(uv.y, m_warpMode);
+
+		glm::vec4 texel(1.0f);
+		//No mipmap: just sampling at the first level
+		if (!m_generateMipmap)
 		{
-			if (u < 0 || u > 1.0f)
-			{
-				switch (m_warpMode)
-				{
-				case TRTextureWarpMode::TR_REPEAT:
-					u = (u > 0) ? (u - (int)u) : (1.0f - ((int)u - u));
-					break;
-				case TRTextureWarpMode::TR_MIRRORED_REPEAT:
-					u = (u > 0) ? (1.0f - (u - (int)u)) : ((int)u - u);
-					break;
-				case TRTextureWarpMode::TR_CLAMP_TO_EDGE:
-					u = (u < 0) ? 0 : 1.0f;
-					break;
-				default:
-					u = (u < 0) ? 0 : 1.0f;
-					break;
-				}
-			}
+			texel = sampleLevel(0, glm::vec2(u, v));
+		}
+		//Mipmap: linear interpolation between two levels
+		else
+		{
+			glm::vec4 texel1(1.0f), texel2(1.0f);
+			unsigned int level1 = glm::min((unsigned int)level, (unsigned int)m_texHolders.size() - 1);
+			unsigned int level2 = glm::min((unsigned int)(level + 1), (unsigned int)m_texHolders.size() - 1);
+			//Trilinear interpolation if filtering mode is TR_LINEAR
+			texel1 = sampleLevel(level1, glm::vec2(u, v));
+			texel2 = (level1 != level2) ? sampleLevel(level2, glm::vec2(u, v)) : texel1;
+			//Interpolation
+			float frac = level - (int)level;
+			texel = (1.0f - frac) * texel1 + frac * texel2;
+		}
+
+		return texel;
+	}
 
-			if (v < 0 || v > 1.0f)
+	void TRTexture2D::sampleQuad(const glm::vec2 *uv, const float &level, glm::vec4 *texels) const
+	{
+		//Texture warpping mode
+		alignas(16) float u[4], v[4];
+#ifdef TR_SIMD_X86
+		{
+			const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+			auto warp = [&](const __m128 &t) -> __m128
 			{
+				//Note: the same as warpCoordinate(), t - (int)t is the signed fractional part
+				const __m128 outside = _mm_or_ps(_mm_cmplt_ps(t, zero), _mm_cmpgt_ps(t, one));
+				const __m128 positive = _mm_cmpgt_ps(t, zero);
+				const __m128 frac = _mm_sub_ps(t, _mm_cvtepi32_ps(_mm_cvttps_epi32(t)));
+				__m128 warpped;
 				switch (m_warpMode)
 				{
 				case TRTextureWarpMode::TR_REPEAT:
-					v = (v > 0) ? (v - (int)v) : (1.0f - ((int)v - v));
+					warpped = _mm_or_ps(_mm_and_ps(positive, frac), _mm_andnot_ps(positive, _mm_add_ps(one, frac)));
 					break;
 				case TRTextureWarpMode::TR_MIRRORED_REPEAT:
-					v = (v > 0) ? (1.0f - (v - (int)v)) : ((int)v - v);
-					break;
-				case TRTextureWarpMode::TR_CLAMP_TO_EDGE:
-					v = (v < 0) ? 0 : 1.0f;
+					warpped = _mm_or_ps(_mm_and_ps(positive, _mm_sub_ps(one, frac)), _mm_andnot_ps(positive, _mm_sub_ps(zero, frac)));
 					break;
 				default:
-					v = (v < 0) ? 0 : 1.0f;
+					warpped = _mm_min_ps(_mm_max_ps(t, zero), one);
 					break;
 				}
-			}
+				warpped = _mm_or_ps(_mm_and_ps(outside, warpped), _mm_andnot_ps(outside, t));
+				//Note: NaN -> 0, so that the texel addresses are always valid
+				return _mm_min_ps(_mm_max_ps(warpped, zero), one);
+			};
+			//uv[0..3] -> u[4], v[4]
+			const __m128 uv01 = _mm_loadu_ps(&uv[0].x), uv23 = _mm_loadu_ps(&uv[2].x);
+			_mm_store_ps(u, warp(_mm_shuffle_ps(uv01, uv23, _MM_SHUFFLE(2, 0, 2, 0))));
+			_mm_store_ps(v, warp(_mm_shuffle_ps(uv01, uv23, _MM_SHUFFLE(3, 1, 3, 1))));
+		}
+#else
+		for (int f = 0; f < 4; ++f)
+		{
+			u[f] = TRTexture2DSampler::warpCoordinate(uv[f].x, m_warpMode);
+			v[f] = TRTexture2DSampler::warpCoordinate(uv[f].y, m_warpMode);
 		}
+#endif
 
-		glm::vec4 texel(1.0f);
 		//No mipmap: just sampling at the first level
 		if (!m_generateMipmap)
 		{
-			switch (m_filteringMode)
+			filterQuadLevel(0, u, v, texels);
+			return;
+		}
+
+		//Mipmap: linear interpolation between two levels
+		unsigned int level1 = glm::min((unsigned int)level, (unsigned int)m_texHolders.size() - 1);
+		unsigned int level2 = glm::min((unsigned int)(level + 1), (unsigned int)m_texHolders.size() - 1);
+		filterQuadLevel(level1, u, v, texels);
+		if (level1 != level2)
+		{
+			glm::vec4 texels2[4];
+			filterQuadLevel(level2, u, v, texels2);
+			float frac = level - (int)level;
+			for (int f = 0; f < 4; ++f)
 			{
-			case TRTextureFilterMode::TR_NEAREST:
-				texel = TRTexture2DSampler::textureSamplingNearest(m_texHolders[0], glm::vec2(u, v));
-				break;
-			case TRTextureFilterMode::TR_LINEAR:
-				texel = TRTexture2DSampler::textureSamplingBilinear(m_texHolders[0], glm::vec2(u, v));
-				break;
-			default:
-				break;
+				texels[f] = (1.0f - frac) * texels[f] + frac * texels2[f];
 			}
 		}
-		//Mipmap: linear interpolation between two levels
-		else
+	}
+
+	int TRTexture2D::calculateFootprint(const glm::vec2 &dUVdx, const glm::vec2 &dUVdy, float &level, glm::vec2 &axis) const
+	{
+		axis = glm::vec2(0.0f);
+		if (!m_generateMipmap)
 		{
-			glm::vec4 texel1(1.0f), texel2(1.0f);
-			unsigned int level1 = glm::min((unsigned int)level, (unsigned int)m_texHolders.size() - 1);
-			unsigned int level2 = glm::min((unsigned int)(level + 1), (unsigned int)m_texHolders.size() - 1);
-			switch (m_filteringMode)
+			level = 0.0f;
+			return 1;
+		}
+
+		//Footprint of the fragment in texel space
+		glm::vec2 dfdx = dUVdx * glm::vec2(getWidth(), getHeight());
+		glm::vec2 dfdy = dUVdy * glm::vec2(getWidth(), getHeight());
+		float Lx = glm::dot(dfdx, dfdx), Ly = glm::dot(dfdy, dfdy);
+
+		//Isotropic: lod level of the major axis
+		if (m_maxAnisotropy == 1)
+		{
+			level = glm::max(0.5f * glm::log2(glm::max(Lx, Ly)), 0.0f);
+			return 1;
+		}
+
+		//Anisotropic: taps along the major axis, lod level of major axis / taps
+		//Refs: https://www.khronos.org/registry/OpenGL/extensions/EXT/EXT_texture_filter_anisotropic.txt
+		float Pmax = glm::sqrt(glm::max(Lx, Ly)), Pmin = glm::sqrt(glm::min(Lx, Ly));
+		int taps = (Pmin * m_maxAnisotropy > Pmax) ? (int)glm::ceil(Pmax / Pmin) : m_maxAnisotropy;
+		taps = glm::max(taps, 1);
+		level = glm::max(glm::log2(Pmax / taps), 0.0f);
+		axis = (Lx > Ly) ? dUVdx : dUVdy;
+		return taps;
+	}
+
+	glm::vec4 TRTexture2D::sample(const glm::vec2 &uv, const glm::vec2 &dUVdx, const glm::vec2 &dUVdy) const
+	{
+		float level;
+		glm::vec2 axis;
+		int taps = calculateFootprint(dUVdx, dUVdy, level, axis);
+		if (taps == 1)
+			return sample(uv, level);
+
+		//Average of the trilinear taps evenly spaced along the major axis
+		glm::vec4 texel(0.0f);
+		for (int i = 0; i < taps; ++i)
+		{
+			texel += sample(uv + axis * ((i + 0.5f) / taps - 0.5f), level);
+		}
+		return texel / (float)taps;
+	}
+
+	void TRTexture2D::sampleQuad(const glm::vec2 *uv, const glm::vec2 &dUVdx, const glm::vec2 &dUVdy, glm::vec4 *texels) const
+	{
+		float level;
+		glm::vec2 axis;
+		int taps = calculateFootprint(dUVdx, dUVdy, level, axis);
+		if (taps == 1)
+		{
+			sampleQuad(uv, level, texels);
+			return;
+		}
+
+		//Note: the taps are shared by the 2x2 fragments block, since so are the derivatives
+		glm::vec2 tapUV[4];
+		glm::vec4 tapTexels[4];
+		texels[0] = texels[1] = texels[2] = texels[3] = glm::vec4(0.0f);
+		for (int i = 0; i < taps; ++i)
+		{
+			const glm::vec2 offset = axis * ((i + 0.5f) / taps - 0.5f);
+			for (int f = 0; f < 4; ++f)
 			{
-			case TRTextureFilterMode::TR_NEAREST:
-				if (level1 != level2)
-				{
-					texel1 = TRTexture2DSampler::textureSamplingNearest(m_texHolders[level1], glm::vec2(u, v));
-					texel2 = TRTexture2DSampler::textureSamplingNearest(m_texHolders[level2], glm::vec2(u, v));
-				}
-				else
-				{
-					texel1 = TRTexture2DSampler::textureSamplingNearest(m_texHolders[level1], glm::vec2(u, v));
-					texel2 = texel1;
-				}
-				break;
-			case TRTextureFilterMode::TR_LINEAR:
-				//Trilinear interpolation
-				if (level1 != level2)
-				{
-					texel1 = TRTexture2DSampler::textureSamplingBilinear(m_texHolders[level1], glm::vec2(u, v));
-					texel2 = TRTexture2DSampler::textureSamplingBilinear(m_texHolders[level2], glm::vec2(u, v));
-				}
-				else
-				{
-					texel1 = TRTexture2DSampler::textureSamplingBilinear(m_texHolders[level1], glm::vec2(u, v));
-					texel2 = texel1;
-				}
-				break;
+				tapUV[f] = uv[f] + offset;
+			}
+			sampleQuad(tapUV, level, tapTexels);
+			for (int f = 0; f < 4; ++f)
+			{
+				texels[f] += tapTexels[f];
 			}
-			//Interpolation
-			float frac = level - (int)level;
-			texel = (1.0f - frac) * texel1 + frac * texel2;
 		}
+		for (int f = 0; f < 4; ++f)
+		{
+			texels[f] /= (float)taps;
+		}
+	}
 
-		return texel;
+	glm::vec4 TRTexture2D::sampleLevel(const unsigned int &level, const glm::vec2 &uv) const
+	{
+		//Note: one switch per sampling instead of virtual calls per texel
+		const TRTextureHolder &texture = *m_texHolders[level];
+		switch (texture.getLayout())
+		{
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_LINEAR:
+			return filterLevel(static_cast<const TRLinearTextureHolder&>(texture), uv);
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_TILING:
+			return filterLevel(static_cast<const TRTilingTextureHolder&>(texture), uv);
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_ZCURVE_TILING:
+			return filterLevel(static_cast<const TRZCurveTilingTextureHolder&>(texture), uv);
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_BC1:
+			return filterLevel(static_cast<const TRBC1TextureHolder&>(texture), uv);
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_BC3:
+			return filterLevel(static_cast<const TRBC3TextureHolder&>(texture), uv);
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_BC4:
+			return filterLevel(static_cast<const TRBC4TextureHolder&>(texture), uv);
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_BC5:
+			return filterLevel(static_cast<const TRBC5TextureHolder&>(texture), uv);
+		default:
+			return glm::vec4(1.0f);
+		}
+	}
+
+	template<typename Holder>
+	glm::vec4 TRTexture2D::filterLevel(const Holder &texture, const glm::vec2 &uv) const
+	{
+		switch (m_filteringMode)
+		{
+		case TRTextureFilterMode::TR_NEAREST:
+			return TRTexture2DSampler::textureSamplingNearest(texture, uv);
+		case TRTextureFilterMode::TR_LINEAR:
+			return TRTexture2DSampler::textureSamplingBilinear(texture, uv);
+		default:
+			return glm::vec4(1.0f);
+		}
+	}
+
+	void TRTexture2D::filterQuadLevel(const unsigned int &level, const float *u, const float *v, glm::vec4 *texels) const
+	{
+		const TRTextureHolder &texture = *m_texHolders[level];
+		switch (texture.getLayout())
+		{
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_LINEAR:
+			filterQuad(static_cast<const TRLinearTextureHolder&>(texture), u, v, texels);
+			break;
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_TILING:
+			filterQuad(static_cast<const TRTilingTextureHolder&>(texture), u, v, texels);
+			break;
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_ZCURVE_TILING:
+			filterQuad(static_cast<const TRZCurveTilingTextureHolder&>(texture), u, v, texels);
+			break;
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_BC1:
+			filterQuad(static_cast<const TRBC1TextureHolder&>(texture), u, v, texels);
+			break;
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_BC3:
+			filterQuad(static_cast<const TRBC3TextureHolder&>(texture), u, v, texels);
+			break;
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_BC4:
+			filterQuad(static_cast<const TRBC4TextureHolder&>(texture), u, v, texels);
+			break;
+		case TRTextureLayout::TR_TEXTURE_LAYOUT_BC5:
+			filterQuad(static_cast<const TRBC5TextureHolder&>(texture), u, v, texels);
+			break;
+		default:
+			break;
+		}
+	}
+
+	template<typename Holder>
+	void TRTexture2D::filterQuad(const Holder &texture, const float *u, const float *v, glm::vec4 *texels) const
+	{
+		switch (m_filteringMode)
+		{
+		case TRTextureFilterMode::TR_NEAREST:
+			TRTexture2DSampler::textureSamplingNearestQuad(texture, u, v, texels);
+			break;
+		case TRTextureFilterMode::TR_LINEAR:
+			TRTexture2DSampler::textureSamplingBilinearQuad(texture, u, v, texels);
+			break;
+		default:
+			break;
+		}
 	}
 
 	//----------------------------------------------TRTexture2DSampler----------------------------------------------
 
-	glm::vec4 TRTexture2DSampler::textureSamplingNearest(TRTextureHolder::ptr texture, glm::vec2 uv)
+	float TRTexture2DSampler::warpCoordinate(const float &t, const TRTextureWarpMode &mode)
+	{
+		if (t >= 0 && t <= 1.0f)
+			return t;
+		switch (mode)
+		{
+		case TRTextureWarpMode::TR_REPEAT:
+			return (t > 0) ? (t - (int)t) : (1.0f - ((int)t - t));
+		case TRTextureWarpMode::TR_MIRRORED_REPEAT:
+			return (t > 0) ? (1.0f - (t - (int)t)) : ((int)t - t);
+		case TRTextureWarpMode::TR_CLAMP_TO_EDGE:
+			return (t < 0) ? 0 : 1.0f;
+		default:
+			return (t < 0) ? 0 : 1.0f;
+		}
+	}
+
+	template<typename Holder>
+	glm::vec4 TRTexture2DSampler::textureSamplingNearest(const Holder &texture, const glm::vec2 &uv)
 	{
 		//Perform nearest sampling procedure
-		unsigned char r, g, b, a = 255;
-		texture->read(
-			(std::uint16_t)(uv.x * (texture->getWidth() - 1)  + 0.5f), //Rounding
-			(std::uint16_t)(uv.y * (texture->getHeight() - 1) + 0.5f), //Rounding
-			r, g, b, a);
-
-		constexpr float denom = 1.0f / 255.0f;
-		return glm::vec4(r, g, b, a) * denom;
+		return texture.fetch(
+			(std::uint16_t)(uv.x * (texture.getWidth() - 1)  + 0.5f), //Rounding
+			(std::uint16_t)(uv.y * (texture.getHeight() - 1) + 0.5f));//Rounding
 	}
 
-	glm::vec4 TRTexture2DSampler::textureSamplingBilinear(TRTextureHolder::ptr texture, glm::vec2 uv)
+	template<typename Holder>
+	glm::vec4 TRTexture2DSampler::textureSamplingBilinear(const Holder &texture, const glm::vec2 &uv)
 	{
 		//Perform bilinear sampling procedure
-		const auto &w = texture->getWidth();
-		const auto &h = texture->getHeight();
+		const auto &w = texture.getWidth();
+		const auto &h = texture.getHeight();
 
 		float fx = (uv.x * (w- 1)), fy = (uv.y * (h - 1));
 		std::uint16_t ix = (std::uint16_t)fx, iy = (std::uint16_t)fy;
@@ -370,22 +590,100 @@ namespace TinyRenderer
 		 *   p0--p1 
 		 * Note: p0 is (ix,iy)
 		 ********************/
-		static constexpr float denom = 1.0f / 255.0f;
-		unsigned char r, g, b, a = 255;
-		
-		//p0
-		texture->read(ix, iy, r, g, b, a);
-		glm::vec4 p0(r, g, b, a);
-		//p1
-		texture->read((ix + 1 >= w) ? ix : (ix + 1), iy, r, g, b, a);
-		glm::vec4 p1(r, g, b, a);
-		//p2
-		texture->read(ix, (iy + 1 >= h) ? iy : (iy + 1), r, g, b, a);
-		glm::vec4 p2(r, g, b, a);
-		//p3
-		texture->read((ix + 1 >= w) ? ix : (ix + 1), (iy + 1 >= h) ? iy : (iy + 1), r, g, b, a);
-		glm::vec4 p3(r, g, b, a);
-		return ((1.0f - frac_x) * (1.0f - frac_y) * p0 + frac_x * (1.0f - frac_y) * p1 +
-			   (1.0f - frac_x) * frac_y * p2 + frac_x * frac_y * p3) * denom;
+		//Fetch the whole 2x2 footprint at once
+		glm::vec4 p[4];
+		texture.fetchQuad(ix, iy, (ix + 1 >= w) ? ix : (ix + 1), (iy + 1 >= h) ? iy : (iy + 1), p);
+		return (1.0f - frac_x) * (1.0f - frac_y) * p[0] + frac_x * (1.0f - frac_y) * p[1] +
+			   (1.0f - frac_x) * frac_y * p[2] + frac_x * frac_y * p[3];
+	}
+
+	template<typename Holder>
+	void TRTexture2DSampler::textureSamplingNearestQuad(const Holder &texture, const float *u, const float *v, glm::vec4 *texels)
+	{
+#ifdef TR_SIMD_X86
+		//Rounding
+		alignas(16) int ix[4], iy[4];
+		_mm_store_si128((__m128i*)ix, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_load_ps(u),
+			_mm_set1_ps((float)(texture.getWidth() - 1))), _mm_set1_ps(0.5f))));
+		_mm_store_si128((__m128i*)iy, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_load_ps(v),
+			_mm_set1_ps((float)(texture.getHeight() - 1))), _mm_set1_ps(0.5f))));
+		for (int f = 0; f < 4; ++f)
+		{
+			texels[f] = texture.fetch((std::uint16_t)ix[f], (std::uint16_t)iy[f]);
+		}
+#else
+		for (int f = 0; f < 4; ++f)
+		{
+			texels[f] = textureSamplingNearest(texture, glm::vec2(u[f], v[f]));
+		}
+#endif
+	}
+
+	template<typename Holder>
+	void TRTexture2DSampler::textureSamplingBilinearQuad(const Holder &texture, const float *u, const float *v, glm::vec4 *texels)
+	{
+#ifdef TR_SIMD_X86
+		//Texel coordinates and bilinear weights of the 4 uv coordinates
+		const int w = texture.getWidth(), h = texture.getHeight();
+		const __m128 fx = _mm_mul_ps(_mm_load_ps(u), _mm_set1_ps((float)(w - 1)));
+		const __m128 fy = _mm_mul_ps(_mm_load_ps(v), _mm_set1_ps((float)(h - 1)));
+		const __m128i ix = _mm_cvttps_epi32(fx), iy = _mm_cvttps_epi32(fy);
+		alignas(16) float fracX[4], fracY[4];
+		_mm_store_ps(fracX, _mm_sub_ps(fx, _mm_cvtepi32_ps(ix)));
+		_mm_store_ps(fracY, _mm_sub_ps(fy, _mm_cvtepi32_ps(iy)));
+
+		//Note: the neighbours are clamped to the edge, i.e. min(i + 1, size - 1)
+		auto clampNext = [](const __m128i &i, const int &size) -> __m128i
+		{
+			const __m128i next = _mm_add_epi32(i, _mm_set1_epi32(1));
+			const __m128i over = _mm_cmpgt_epi32(next, _mm_set1_epi32(size - 1));
+			return _mm_or_si128(_mm_and_si128(over, i), _mm_andnot_si128(over, next));
+		};
+		alignas(16) int x0[4], y0[4], x1[4], y1[4];
+		_mm_store_si128((__m128i*)x0, ix);
+		_mm_store_si128((__m128i*)y0, iy);
+		_mm_store_si128((__m128i*)x1, clampNext(ix, w));
+		_mm_store_si128((__m128i*)y1, clampNext(iy, h));
+
+		/*********************
+		 *   p2--p3
+		 *   |   |
+		 *   p0--p1
+		 ********************/
+		for (int f = 0; f < 4; ++f)
+		{
+			//Note: the texels are decoded from the texel format by fetchQuad()
+			glm::vec4 p[4];
+			texture.fetchQuad((std::uint16_t)x0[f], (std::uint16_t)y0[f], (std::uint16_t)x1[f], (std::uint16_t)y1[f], p);
+			const float fx = fracX[f], fy = fracY[f];
+			__m128 texel = _mm_mul_ps(_mm_loadu_ps(&p[0].x), _mm_set1_ps((1.0f - fx) * (1.0f - fy)));
+			texel = _mm_add_ps(texel, _mm_mul_ps(_mm_loadu_ps(&p[1].x), _mm_set1_ps(fx * (1.0f - fy))));
+			texel = _mm_add_ps(texel, _mm_mul_ps(_mm_loadu_ps(&p[2].x), _mm_set1_ps((1.0f - fx) * fy)));
+			texel = _mm_add_ps(texel, _mm_mul_ps(_mm_loadu_ps(&p[3].x), _mm_set1_ps(fx * fy)));
+			_mm_storeu_ps(&texels[f].x, texel);
+		}
+#else
+		for (int f = 0; f < 4; ++f)
+		{
+			texels[f] = textureSamplingBilinear(texture, glm::vec2(u[f], v[f]));
+		}
+#endif
 	}
+
+	//Explicit instantiation for the texture layouts
+#define TR_INSTANTIATE_SAMPLERS(Holder) \
+	template glm::vec4 TRTexture2DSampler::textureSamplingNearest(const Holder &, const glm::vec2 &); \
+	template glm::vec4 TRTexture2DSampler::textureSamplingBilinear(const Holder &, const glm::vec2 &); \
+	template void TRTexture2DSampler::textureSamplingNearestQuad(const Holder &, const float *, const float *, glm::vec4 *); \
+	template void TRTexture2DSampler::textureSamplingBilinearQuad(const Holder &, const float *, const float *, glm::vec4 *);
+
+	TR_INSTANTIATE_SAMPLERS(TRLinearTextureHolder)
+	TR_INSTANTIATE_SAMPLERS(TRTilingTextureHolder)
+	TR_INSTANTIATE_SAMPLERS(TRZCurveTilingTextureHolder)
+	TR_INSTANTIATE_SAMPLERS(TRBC1TextureHolder)
+	TR_INSTANTIATE_SAMPLERS(TRBC3TextureHolder)
+	TR_INSTANTIATE_SAMPLERS(TRBC4TextureHolder)
+	TR_INSTANTIATE_SAMPLERS(TRBC5TextureHolder)
+
+#undef TR_INSTANTIATE_SAMPLERS
 }
\ No newline at end of file
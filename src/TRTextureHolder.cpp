@@ -6,54 +6,116 @@ namespace TinyRenderer
 {
 	//----------------------------------------------TRTextureHolder----------------------------------------------
 
-	TRTextureHolder::TRTextureHolder(std::uint16_t width, std::uint16_t height)
-		: m_width(width), m_height(height), m_data(nullptr) {}
+	TRTextureHolder::TRTextureHolder(std::uint16_t width, std::uint16_t height, TRTextureLayout layout, TRTextureFormat format)
+		: m_width(width), m_height(height), m_data(nullptr), m_layout(layout), m_format(format) {}
 
 	TRTextureHolder::~TRTextureHolder() { freeTexture(); }
 
-	std::uint32_t TRTextureHolder::read(const std::uint16_t &x, const std::uint16_t &y) const
+	int TRTextureHolder::getBytesPerTexel(const TRTextureFormat &format)
 	{
-		//Please guarantee that x and y are in [0,width-1],[0,height-1] respectively
-		return m_data[xyToIndex(x, y)];
+		switch (format)
+		{
+		case TRTextureFormat::TR_TEXTURE_FORMAT_R8:		 return 1;
+		case TRTextureFormat::TR_TEXTURE_FORMAT_RG8:	 return 2;
+		case TRTextureFormat::TR_TEXTURE_FORMAT_RGB565:	 return 2;
+		case TRTextureFormat::TR_TEXTURE_FORMAT_RGBA16F: return 8;
+		default:										 return 4;
+		}
 	}
 
-	void TRTextureHolder::read(const std::uint16_t &x, const std::uint16_t &y, unsigned char &r, unsigned char &g,
-		unsigned char &b, unsigned char &a) const
+	glm::vec4 TRTextureHolder::read(const std::uint16_t &x, const std::uint16_t &y) const
 	{
 		//Please guarantee that x and y are in [0,width-1],[0,height-1] respectively
-		std::uint32_t texel = read(x, y);
-		r = (texel >> 24) & 0xFF;
-		g = (texel >> 16) & 0xFF;
-		b = (texel >>  8) & 0xFF;
-		a = (texel >>  0) & 0xFF;
+		return fetchTexel(xyToIndex(x, y));
 	}
 
-	void TRTextureHolder::loadTexture(const unsigned int &nElements, unsigned char *data, const std::uint16_t &width,
+	std::uint16_t TRTextureHolder::floatToHalf(const float &value)
+	{
+		//Refs: https://gist.github.com/rygorous/2156668 (float_to_half_fast3_rtne)
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(float));
+		const std::uint32_t sign = bits & 0x80000000u;
+		bits ^= sign;
+
+		std::uint16_t half;
+		if (bits >= ((127u + 16u) << 23))
+		{
+			//Overflow -> Inf, NaN -> quiet NaN
+			half = (bits > (255u << 23)) ? 0x7E00 : 0x7C00;
+		}
+		else if (bits < (113u << 23))
+		{
+			//Denormal/zero: rounded by the float unit with a magic addition
+			static constexpr std::uint32_t denormMagicBits = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+			float f, denormMagic;
+			std::memcpy(&f, &bits, sizeof(float));
+			std::memcpy(&denormMagic, &denormMagicBits, sizeof(float));
+			f += denormMagic;
+			std::memcpy(&bits, &f, sizeof(float));
+			half = (std::uint16_t)(bits - denormMagicBits);
+		}
+		else
+		{
+			//Normal: rebias the exponent and round the mantissa to nearest even
+			const std::uint32_t mantOdd = (bits >> 13) & 1;
+			bits -= (127u - 15u) << 23;
+			bits += 0xFFF + mantOdd;
+			half = (std::uint16_t)(bits >> 13);
+		}
+		return half | (std::uint16_t)(sign >> 16);
+	}
+
+	template<typename T>
+	void TRTextureHolder::loadTexture(const unsigned int &nElements, const T *data, const std::uint16_t &width,
 		const std::uint16_t &height, const int &channel)
 	{
-		//Unified to 32bpp texel format
-		m_data = new std::uint32_t[nElements];
+		//Converted to the texel format directly from the channels of image
+		//Note: the padding texels are zeroed
+		m_data = new unsigned char[nElements * getBytesPerTexel(m_format)]();
 		parallelFor((int)0, (int)(height * width), [&](const int &index) -> void
 		{
 			int y = index / width, x = index % width;
-			unsigned char r, g, b, a;
-			int addres = index * channel;
-			switch (channel)
+			const T *pixel = &data[index * channel];
+			const unsigned int texel = xyToIndex(x, y);
+			switch (m_format)
 			{
-			case 1://R
-				r = g = b = data[addres], a = 255;
+			case TRTextureFormat::TR_TEXTURE_FORMAT_R8:
+				m_data[texel] = toUnorm8(pixel[0]);
 				break;
-			case 3://RGB
-				r = data[addres + 0], g = data[addres + 1], b = data[addres + 2], a = 255;
+			case TRTextureFormat::TR_TEXTURE_FORMAT_RG8:
+				m_data[texel * 2 + 0] = toUnorm8(pixel[0]);
+				m_data[texel * 2 + 1] = (channel >= 2) ? toUnorm8(pixel[1]) : 0;
 				break;
-			case 4://RGBA
-				r = data[addres + 0], g = data[addres + 1], b = data[addres + 2], a = data[addres + 3];
+			case TRTextureFormat::TR_TEXTURE_FORMAT_RGB565:
+			{
+				const unsigned int r = toUnorm8(pixel[0]);
+				const unsigned int g = (channel >= 3) ? toUnorm8(pixel[1]) : r;
+				const unsigned int b = (channel >= 3) ? toUnorm8(pixel[2]) : r;
+				//Rounding to 5/6 bits
+				reinterpret_cast<std::uint16_t*>(m_data)[texel] = (std::uint16_t)
+					((((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) | ((b * 31 + 127) / 255));
 				break;
+			}
+			case TRTextureFormat::TR_TEXTURE_FORMAT_RGBA16F:
+			{
+				std::uint16_t *target = &reinterpret_cast<std::uint16_t*>(m_data)[texel * 4];
+				const float r = toFloat(pixel[0]);
+				target[0] = floatToHalf(r);
+				target[1] = floatToHalf((channel >= 3) ? toFloat(pixel[1]) : r);
+				target[2] = floatToHalf((channel >= 3) ? toFloat(pixel[2]) : r);
+				target[3] = floatToHalf((channel == 2 || channel == 4) ? toFloat(pixel[channel - 1]) : 1.0f);
+				break;
+			}
 			default:
-				r = g = b = data[addres], a = 255;
+			{
+				unsigned char *target = &m_data[texel * 4];
+				target[0] = toUnorm8(pixel[0]);
+				target[1] = (channel >= 3) ? toUnorm8(pixel[1]) : target[0];
+				target[2] = (channel >= 3) ? toUnorm8(pixel[2]) : target[0];
+				target[3] = (channel == 2 || channel == 4) ? toUnorm8(pixel[channel - 1]) : 255;
 				break;
 			}
-			m_data[xyToIndex(x, y)] = (r << 24) | (g << 16) | (b << 8) | (a << 0);
+			}
 		});
 	}
 
@@ -68,8 +130,9 @@ namespace TinyRenderer
 
 	//----------------------------------------------TRLinearTextureHolder----------------------------------------------
 
-	TRLinearTextureHolder::TRLinearTextureHolder(unsigned char *data, std::uint16_t width, std::uint16_t height, int channel)
-		: TRTextureHolder(width, height)
+	template<typename T>
+	TRLinearTextureHolder::TRLinearTextureHolder(const T *data, std::uint16_t width, std::uint16_t height, int channel,
+		TRTextureFormat format) : TRTextureHolder(width, height, TR_TEXTURE_LAYOUT_LINEAR, format)
 	{
 		TRTextureHolder::loadTexture(width * height, data, width, height, channel);
 	}
@@ -77,13 +140,14 @@ namespace TinyRenderer
 	unsigned int TRLinearTextureHolder::xyToIndex(const std::uint16_t &x, const std::uint16_t &y) const
 	{
 		//Linear address mapping
-		return y * m_width + x;
+		return rowOffset(y) + colOffset(x);
 	}
 
 	//----------------------------------------------TRTilingTextureHolder----------------------------------------------
 
-	TRTilingTextureHolder::TRTilingTextureHolder(unsigned char *data, std::uint16_t width, std::uint16_t height, int channel)
-		: TRTextureHolder(width, height)
+	template<typename T>
+	TRTilingTextureHolder::TRTilingTextureHolder(const T *data, std::uint16_t width, std::uint16_t height, int channel,
+		TRTextureFormat format) : TRTextureHolder(width, height, TR_TEXTURE_LAYOUT_TILING, format)
 	{
 		m_widthInTiles = (width + k_blockSize - 1) / k_blockSize;
 		m_heightInTiles = (height + k_blockSize - 1) / k_blockSize;
@@ -98,13 +162,16 @@ namespace TinyRenderer
 		//Note: this is naive version
 		//return ((int)(y / k_blockSize) * m_widthInTiles + (int)(x / k_blockSize)) * k_blockSize2 + (y % k_blockSize) * k_blockSize + x % k_blockSize;
 		//Note: this is optimized version
-		return (((int)(y >> 2) * m_widthInTiles + (int)(x >> 2)) << 4) + ((y & 3) << 2) + (x & 3);
+		//return (((int)(y >> 2) * m_widthInTiles + (int)(x >> 2)) << 4) + ((y & 3) << 2) + (x & 3);
+		//Note: this is separable version shared with fetchQuad()
+		return rowOffset(y) + colOffset(x);
 	}
 
 	//----------------------------------------------TRZCurveTilingTextureHolder----------------------------------------------
 
-	TRZCurveTilingTextureHolder::TRZCurveTilingTextureHolder(unsigned char *data, std::uint16_t width, std::uint16_t height, int channel)
-		: TRTextureHolder(width, height)
+	template<typename T>
+	TRZCurveTilingTextureHolder::TRZCurveTilingTextureHolder(const T *data, std::uint16_t width, std::uint16_t height, int channel,
+		TRTextureFormat format) : TRTextureHolder(width, height, TR_TEXTURE_LAYOUT_ZCURVE_TILING, format)
 	{
 		m_widthInTiles = (width + k_blockSize - 1) / k_blockSize;
 		m_heightInTiles = (height + k_blockSize - 1) / k_blockSize;
@@ -116,9 +183,204 @@ namespace TinyRenderer
 	unsigned int TRZCurveTilingTextureHolder::xyToIndex(const std::uint16_t &x, const std::uint16_t &y) const
 	{
 		//Address mapping
-		std::uint8_t rx = x & (k_blockSize - 1), ry = y & (k_blockSize - 1);
-		std::uint16_t ri = 0;
-		TRZCurveTilingTextureHolder::encodeMortonCurve(rx, ry, ri);
-		return ((y >> bits) * m_widthInTiles + (x  >> bits)) * k_blockSize2 + ri;
+		//Note: the tile offset plus the morton code of (x,y) in the tile, where the spread bits of x are the 
+		//      even bits and the ones of y are the odd bits, i.e. rowOffset(y) + colOffset(x)
+		return rowOffset(y) + colOffset(x);
 	}
+
+	//Explicit instantiation for the channel types of image (8-bit and HDR)
+#define TR_INSTANTIATE_HOLDERS(T) \
+	template TRLinearTextureHolder::TRLinearTextureHolder(const T *, std::uint16_t, std::uint16_t, int, TRTextureFormat); \
+	template TRTilingTextureHolder::TRTilingTextureHolder(const T *, std::uint16_t, std::uint16_t, int, TRTextureFormat); \
+	template TRZCurveTilingTextureHolder::TRZCurveTilingTextureHolder(const T *, std::uint16_t, std::uint16_t, int, TRTextureFormat);
+
+	TR_INSTANTIATE_HOLDERS(unsigned char)
+	TR_INSTANTIATE_HOLDERS(float)
+
+#undef TR_INSTANTIATE_HOLDERS
+
+	//----------------------------------------------TRBlockCodec----------------------------------------------
+
+	std::uint64_t TRBlockCodec::encodeBC1(const unsigned char *rgba)
+	{
+		//Endpoints: bounding box of the colors inset by 1/16 of its size
+		//Refs: J.M.P. van Waveren, Real-Time DXT Compression
+		int minC[3] = { 255, 255, 255 }, maxC[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				minC[c] = std::min(minC[c], (int)rgba[i * 4 + c]);
+				maxC[c] = std::max(maxC[c], (int)rgba[i * 4 + c]);
+			}
+		}
+		for (int c = 0; c < 3; ++c)
+		{
+			const int inset = (maxC[c] - minC[c]) >> 4;
+			minC[c] += inset;
+			maxC[c] -= inset;
+		}
+		auto toRGB565 = [](const int *c) -> unsigned int
+		{
+			return ((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3);
+		};
+		unsigned int c0 = toRGB565(maxC), c1 = toRGB565(minC);
+		//Note: c0 > c1 -> 4 colors mode, c0 == c1 -> a single color
+		if (c0 < c1)
+			std::swap(c0, c1);
+		std::uint64_t block = c0 | (c1 << 16);
+		if (c0 == c1)
+			return block;
+
+		//Indices: the nearest color of the palette
+		std::uint32_t palette[4];
+		for (unsigned int p = 0; p < 4; ++p)
+		{
+			palette[p] = decodeBC1(block | ((std::uint64_t)p << 32), 0, false);
+		}
+		for (int i = 0; i < 16; ++i)
+		{
+			unsigned int best = 0;
+			int bestDist = 0x7FFFFFFF;
+			for (unsigned int p = 0; p < 4; ++p)
+			{
+				const int dr = (int)((palette[p] >> 24) & 0xFF) - rgba[i * 4 + 0];
+				const int dg = (int)((palette[p] >> 16) & 0xFF) - rgba[i * 4 + 1];
+				const int db = (int)((palette[p] >>  8) & 0xFF) - rgba[i * 4 + 2];
+				const int dist = dr * dr + dg * dg + db * db;
+				if (dist < bestDist)
+				{
+					bestDist = dist;
+					best = p;
+				}
+			}
+			block |= (std::uint64_t)best << (32 + 2 * i);
+		}
+		return block;
+	}
+
+	std::uint64_t TRBlockCodec::encodeBC4(const unsigned char *values)
+	{
+		//Endpoints: v0 = max > v1 = min -> 8 values mode
+		unsigned int v0 = 0, v1 = 255;
+		for (int i = 0; i < 16; ++i)
+		{
+			v0 = std::max(v0, (unsigned int)values[i]);
+			v1 = std::min(v1, (unsigned int)values[i]);
+		}
+		std::uint64_t block = v0 | (v1 << 8);
+		if (v0 == v1)
+			return block;
+
+		//Indices: t-th of the 8 values from v0 (t = 0) to v1 (t = 7), i.e. index 0, 2, 3, ..., 7, 1
+		for (int i = 0; i < 16; ++i)
+		{
+			const unsigned int t = ((v0 - values[i]) * 14 + (v0 - v1)) / (2 * (v0 - v1));//Rounding
+			const std::uint64_t index = (t == 0) ? 0 : (t == 7 ? 1 : t + 1);
+			block |= index << (16 + 3 * i);
+		}
+		return block;
+	}
+
+	//----------------------------------------------TRBlockCompressedTextureHolder----------------------------------------------
+
+	template<TRTextureLayout Layout>
+	template<typename T>
+	TRBlockCompressedTextureHolder<Layout>::TRBlockCompressedTextureHolder(const T *data, std::uint16_t width, 
+		std::uint16_t height, int channel) : TRTextureHolder(width, height, Layout)
+	{
+		m_widthInBlocks = (width + 3) / 4;
+		m_heightInBlocks = (height + 3) / 4;
+		m_blocks.resize(m_widthInBlocks * m_heightInBlocks * k_blockWords);
+
+		parallelFor((int)0, (int)(m_widthInBlocks * m_heightInBlocks), [&](const int &index) -> void
+		{
+			//Gather 16 texels of the block in RGBA
+			//Note: clamp to the edge for padding
+			const int bx = index % m_widthInBlocks, by = index / m_widthInBlocks;
+			unsigned char rgba[16 * 4];
+			for (int i = 0; i < 16; ++i)
+			{
+				const int x = std::min(bx * 4 + (i & 3), width - 1), y = std::min(by * 4 + (i >> 2), height - 1);
+				const int addres = (y * width + x) * channel;
+				unsigned char *texel = &rgba[i * 4];
+				switch (channel)
+				{
+				case 3://RGB
+					texel[0] = toUnorm8(data[addres + 0]), texel[1] = toUnorm8(data[addres + 1]), 
+					texel[2] = toUnorm8(data[addres + 2]), texel[3] = 255;
+					break;
+				case 4://RGBA
+					texel[0] = toUnorm8(data[addres + 0]), texel[1] = toUnorm8(data[addres + 1]), 
+					texel[2] = toUnorm8(data[addres + 2]), texel[3] = toUnorm8(data[addres + 3]);
+					break;
+				case 2://Gray, alpha
+					texel[0] = texel[1] = texel[2] = toUnorm8(data[addres]), texel[3] = toUnorm8(data[addres + 1]);
+					break;
+				default://R
+					texel[0] = texel[1] = texel[2] = toUnorm8(data[addres]), texel[3] = 255;
+					break;
+				}
+			}
+
+			//Encoding
+			std::uint64_t *block = &m_blocks[index * k_blockWords];
+			unsigned char values[16];
+			auto gatherChannel = [&](const int &c) -> const unsigned char*
+			{
+				for (int i = 0; i < 16; ++i)
+				{
+					values[i] = rgba[i * 4 + c];
+				}
+				return values;
+			};
+			switch (Layout)
+			{
+			case TR_TEXTURE_LAYOUT_BC1:
+				block[0] = TRBlockCodec::encodeBC1(rgba);
+				break;
+			case TR_TEXTURE_LAYOUT_BC3:
+				block[0] = TRBlockCodec::encodeBC4(gatherChannel(3));
+				block[1] = TRBlockCodec::encodeBC1(rgba);
+				break;
+			case TR_TEXTURE_LAYOUT_BC4:
+				//Luminance
+				for (int i = 0; i < 16; ++i)
+				{
+					values[i] = (unsigned char)((299 * rgba[i * 4 + 0] + 587 * rgba[i * 4 + 1] + 114 * rgba[i * 4 + 2] + 500) / 1000);
+				}
+				block[0] = TRBlockCodec::encodeBC4(values);
+				break;
+			case TR_TEXTURE_LAYOUT_BC5:
+				block[0] = TRBlockCodec::encodeBC4(gatherChannel(0));
+				block[1] = TRBlockCodec::encodeBC4(gatherChannel(1));
+				break;
+			default:
+				break;
+			}
+		});
+	}
+
+	template<TRTextureLayout Layout>
+	unsigned int TRBlockCompressedTextureHolder<Layout>::xyToIndex(const std::uint16_t &x, const std::uint16_t &y) const
+	{
+		//Texel index in the order of blocks
+		return (((y >> 2) * m_widthInBlocks + (x >> 2)) << 4) + ((y & 3) << 2) + (x & 3);
+	}
+
+	template class TRBlockCompressedTextureHolder<TR_TEXTURE_LAYOUT_BC1>;
+	template class TRBlockCompressedTextureHolder<TR_TEXTURE_LAYOUT_BC3>;
+	template class TRBlockCompressedTextureHolder<TR_TEXTURE_LAYOUT_BC4>;
+	template class TRBlockCompressedTextureHolder<TR_TEXTURE_LAYOUT_BC5>;
+
+#define TR_INSTANTIATE_HOLDERS(T) \
+	template TRBC1TextureHolder::TRBlockCompressedTextureHolder(const T *, std::uint16_t, std::uint16_t, int); \
+	template TRBC3TextureHolder::TRBlockCompressedTextureHolder(const T *, std::uint16_t, std::uint16_t, int); \
+	template TRBC4TextureHolder::TRBlockCompressedTextureHolder(const T *, std::uint16_t, std::uint16_t, int); \
+	template TRBC5TextureHolder::TRBlockCompressedTextureHolder(const T *, std::uint16_t, std::uint16_t, int);
+
+	TR_INSTANTIATE_HOLDERS(unsigned char)
+	TR_INSTANTIATE_HOLDERS(float)
+
+#undef TR_INSTANTIATE_HOLDERS
 }
\ No newline at end of file